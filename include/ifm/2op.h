@@ -23,33 +23,156 @@ SOFTWARE.
 #ifndef IFM_2OP_H
 #define IFM_2OP_H
 #include <array>
-#include <vector>
-#include <utility>
 #include <tuple>
+#include <vector>
+#include <cmath>
+#include "ifm/setter.h"
+#include "ifm/dual.h"
+#include "ifm/levenberg_marquardt.h"
+#include "ifm/sideband.h"
 namespace ifm {
-  constexpr int max_harmony = 50;
+  class fit_cache;
+  constexpr unsigned int default_harmony_count = 50u;
+  enum class fit_search_t {
+    descent,
+    grid
+  };
+  struct fit_config_t {
+    fit_config_t() : max_iteration( 50000u ), patience( 200u ), loss_tolerance( 1.0e-6f ), gradient_tolerance( 1.0e-6f ), step_tolerance( 1.0e-6f ), learning_rate( 0.001f ),
+      search( fit_search_t::grid ), grid_max_b( 20.f ), grid_step( 0.05f ), basin_count( 4u ), chunk_size( 32u ), solver( fit_solver_t::adam ),
+      harmony_count( default_harmony_count ) {}
+    IFM_SET_SMALL_VALUE( max_iteration )
+    IFM_SET_SMALL_VALUE( patience )
+    IFM_SET_SMALL_VALUE( loss_tolerance )
+    IFM_SET_SMALL_VALUE( gradient_tolerance )
+    IFM_SET_SMALL_VALUE( step_tolerance )
+    IFM_SET_SMALL_VALUE( learning_rate )
+    IFM_SET_SMALL_VALUE( search )
+    IFM_SET_SMALL_VALUE( grid_max_b )
+    IFM_SET_SMALL_VALUE( grid_step )
+    IFM_SET_SMALL_VALUE( basin_count )
+    IFM_SET_SMALL_VALUE( chunk_size )
+    IFM_SET_SMALL_VALUE( solver )
+    IFM_SET_SMALL_VALUE( harmony_count )
+    unsigned int max_iteration;
+    unsigned int patience;
+    float loss_tolerance;
+    float gradient_tolerance;
+    float step_tolerance;
+    float learning_rate;
+    fit_search_t search;
+    float grid_max_b;
+    float grid_step;
+    unsigned int basin_count;
+    unsigned int chunk_size;
+    fit_solver_t solver;
+    unsigned int harmony_count;
+  };
+  enum class fit_stop_reason_t {
+    iteration_limit,
+    loss_converged,
+    gradient_converged,
+    step_converged,
+    pruned
+  };
+  struct fit_stats_t {
+    fit_stats_t() : freq( 0u ), initial_b( 0 ), iteration( 0u ), initial_loss( 0 ), final_loss( 0 ), reason( fit_stop_reason_t::iteration_limit ) {}
+    unsigned int freq;
+    float initial_b;
+    unsigned int iteration;
+    float initial_loss;
+    float final_loss;
+    fit_stop_reason_t reason;
+  };
+  const char *to_string( fit_stop_reason_t reason );
+  template< typename T >
+  std::tuple< T, T > spectrum_loss(
+    const float *expected,
+    const sideband_kernel &kernel,
+    const T *magnitude
+  ) {
+    using std::abs;
+    T loss{};
+    T d{};
+    for( unsigned int i = 0; i != kernel.get_harmony_count(); ++i ) {
+      const float e = std::abs( expected[ i ] );
+      if( kernel.is_reachable( i ) ) {
+        const T s = abs( e - magnitude[ i ] );
+        loss += s;
+        d += s;
+      }
+      else loss += e;
+    }
+    return std::make_tuple( loss, d );
+  }
   std::tuple< float, float > lossimage(
     const float *expected,
-    const std::vector< std::pair< float, float > > &pre,
-    unsigned int freq,
-    float b,
-    const std::array< int, max_harmony > &n
+    const sideband_kernel &kernel,
+    float b
   );
-  std::tuple< float, unsigned int, float > find_b_2op(
+  std::tuple< float, float > lossimage(
     const float *expected,
-    const std::vector< std::pair< float, float > > &pre
+    const sideband_kernel &kernel,
+    const float *magnitude
   );
-  std::array< int, max_harmony > generate_n(
-    unsigned int freq
+  void lossimage(
+    const float *expected,
+    const sideband_kernel &kernel,
+    const float *b,
+    unsigned int b_count,
+    float *loss,
+    float *gradient = nullptr
+  );
+  void lossimage(
+    const float *expected,
+    const std::vector< sideband_kernel > &kernels,
+    const float *b,
+    unsigned int b_count,
+    float *loss,
+    float *gradient = nullptr
+  );
+  float loss_lower_bound(
+    const float *expected,
+    const sideband_kernel &kernel
+  );
+  std::tuple< float, unsigned int, float > find_b_2op(
+    const float *expected,
+    const fit_config_t &config = fit_config_t(),
+    std::vector< fit_stats_t > *stats = nullptr,
+    fit_cache *cache = nullptr
   );
   std::tuple< float, float > find_b_2op(
     const float *expected,
-    const std::vector< std::pair< float, float > > &pre,
     unsigned int freq,
+    const fit_config_t &config = fit_config_t(),
+    std::vector< fit_stats_t > *stats = nullptr
+  );
+  std::tuple< float, float > find_b_2op(
+    const float *expected,
+    const sideband_kernel &kernel,
     float initial_b,
-    const std::array< int, max_harmony > &n
+    const fit_config_t &config = fit_config_t(),
+    std::vector< fit_stats_t > *stats = nullptr
+  );
+  std::tuple< float, float > find_b_2op(
+    const float *expected,
+    const sideband_kernel &kernel,
+    const float *initial_b,
+    unsigned int initial_b_count,
+    const fit_config_t &config = fit_config_t(),
+    std::vector< fit_stats_t > *stats = nullptr
+  );
+  std::vector< std::tuple< float, float > > find_b_2op_frames(
+    const float *expected,
+    unsigned int stride,
+    unsigned int frame_count,
+    unsigned int origin,
+    float origin_b,
+    const sideband_kernel &kernel,
+    const fit_config_t &config = fit_config_t(),
+    std::vector< fit_stats_t > *stats = nullptr,
+    fit_cache *cache = nullptr
   );
 }
 
 #endif
-
@@ -23,12 +23,15 @@ SOFTWARE.
 #ifndef IFM_BESSEL_H
 #define IFM_BESSEL_H
 #include <vector>
+#include <functional>
+#include <span>
 #include <utility>
 #include <cmath>
 namespace ifm {
   float bessel_kind1_1( float b, int n );
   float bessel_kind1_0( float b, int n );
   float bessel_kind1( float b, int n );
+  double bessel_kind1_reference( double x, int n );
   float bessel_kind1_approx_2013( float b, int n );
   float bessel_kind1_approx_2019_0( float x );
   float bessel_kind1_approx_2019_1( float x );
@@ -36,11 +39,16 @@ namespace ifm {
   float bessel_kind1_approx_2019_( float x, int n );
   float bessel_kind1_approx_2019( float x, int n );
   float bessel_kind1_approx_2019( float x, int n, float l1, float l2 );
-  float bessel_kind1_approx_2019( float x, int n, const std::vector< std::pair< float, float > > &pre );
-  float bessel_kind1_approx_2019( float x, int n, float l1, float l2, const std::vector< std::pair< float, float > > &pre );
+  float bessel_kind1_approx_2019( float x, int n, std::span< const std::pair< float, float > > pre );
+  float bessel_kind1_approx_2019( float x, int n, float l1, float l2, std::span< const std::pair< float, float > > pre );
   float bessel_kind1_approx_2019_original1( float x, int n );
   float bessel_kind1_approx_2019_original2( float x, int n );
-  std::vector< std::pair< float, float > > create_bessel_approx_2019_precomp_array( int max );
+  using progress_callback_t = std::function< void( size_t, size_t ) >;
+  std::vector< std::pair< float, float > > create_bessel_approx_2019_precomp_array( int max, const progress_callback_t &progress = progress_callback_t() );
+  void bessel_kind1_sequence( float x, unsigned int count, float *dest );
+  std::vector< float > bessel_kind1_sequence( float x, unsigned int count );
+  void bessel_kind1_sequence( float x, unsigned int count, float *value, float *derivative, float *second_derivative = nullptr );
+  void bessel_kind1_sequence( const float *x, unsigned int x_count, unsigned int count, float *dest );
 }
 #endif
 
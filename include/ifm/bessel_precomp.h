@@ -0,0 +1,58 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_BESSEL_PRECOMP_H
+#define IFM_BESSEL_PRECOMP_H
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include "ifm/mapped_file.h"
+
+namespace ifm {
+  struct invalid_bessel_precomp {};
+  struct bessel_precomp_header_t {
+    std::array< char, 8u > magic;
+    uint32_t version;
+    uint32_t max_order;
+    uint32_t precision;
+    uint32_t checksum;
+  };
+  class bessel_precomp {
+  public:
+    bessel_precomp();
+    explicit bessel_precomp( const std::string &filename );
+    std::span< const std::pair< float, float > > get() const { return values; }
+    operator std::span< const std::pair< float, float > >() const { return values; }
+  private:
+    std::shared_ptr< const mapped_file > file;
+    std::shared_ptr< const std::vector< std::pair< float, float > > > storage;
+    std::span< const std::pair< float, float > > values;
+  };
+  std::span< const std::pair< float, float > > embedded_bessel_precomp();
+  void save_bessel_precomp( const std::string &filename, std::span< const std::pair< float, float > > values );
+}
+
+#endif
@@ -0,0 +1,65 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_BESSEL_TABLE_H
+#define IFM_BESSEL_TABLE_H
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <memory>
+#include <string>
+#include <tuple>
+#include "ifm/bessel.h"
+#include "ifm/mapped_file.h"
+
+namespace ifm {
+  struct invalid_bessel_table {};
+  struct bessel_table_header_t {
+    std::array< char, 8u > magic;
+    uint32_t version;
+    uint32_t order_count;
+    uint32_t point_count;
+    float step;
+  };
+  class bessel_table {
+  public:
+    bessel_table( float max_x, float step, unsigned int order_count, const progress_callback_t &progress = progress_callback_t() );
+    explicit bessel_table( const std::string &filename );
+    float operator()( float x, unsigned int n ) const;
+    void operator()( float x, unsigned int count, float *dest ) const;
+    std::tuple< float, float > value_and_derivative( float x, unsigned int n ) const;
+    void save( const std::string &filename ) const;
+    float get_max_x() const { return step * float( point_count - 1u ); }
+    float get_step() const { return step; }
+    unsigned int get_order_count() const { return order_count; }
+  private:
+    void validate( size_t size );
+    std::shared_ptr< const mapped_file > file;
+    std::shared_ptr< const std::vector< float > > storage;
+    const float *values;
+    unsigned int order_count;
+    unsigned int point_count;
+    float step;
+  };
+}
+
+#endif
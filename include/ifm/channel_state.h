@@ -27,16 +27,19 @@ SOFTWARE.
 
 namespace ifm {
   struct channel_state {
-    channel_state( channel_t index_ ) : index( index_ ), modulation( 0 ), volume( 1 ), expression( 1 ), final_volume( 1 ), pitch_bend( 0 ), pitch_sensitivity( 1 ), final_pitch( 0 ), pan( 0 ) {}
+    channel_state( channel_t index_ ) : index( index_ ), modulation( 0 ), volume( 1 ), expression( 1 ), final_volume( 1 ), pitch_bend( 0 ), pitch_sensitivity( 2 ), final_pitch( 0 ), pan( 0 ), sustain( false ), vibrato_phase( 0 ), applied_pitch( 0 ) {}
     void reset() {
       modulation = 0;
       volume = 1;
       expression = 1;
       final_volume = 1;
       pitch_bend = 0;
-      pitch_sensitivity = 1;
+      pitch_sensitivity = 2;
       final_pitch = 0;
       pan = 0;
+      sustain = false;
+      vibrato_phase = 0;
+      applied_pitch = 0;
     }
     channel_t index;
     float modulation;
@@ -48,6 +51,8 @@ namespace ifm {
     float final_pitch;
     float pan;
     bool sustain;
+    float vibrato_phase;
+    float applied_pitch;
   };
 }
 
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_DUAL_H
+#define IFM_DUAL_H
+#include <cmath>
+#include <array>
+#include <cstddef>
+#include <type_traits>
+namespace ifm {
+  template< typename T, std::size_t n = 1u >
+  struct dual {
+    dual() : value{}, gradient{} {}
+    template< typename U, typename std::enable_if< std::is_arithmetic< U >::value && !std::is_same< U, T >::value >::type* = nullptr >
+    dual( U v ) : value( T{} + v ), gradient{} {}
+    dual( const T &v ) : value( v ), gradient{} {}
+    dual( const T &v, const std::array< T, n > &g ) : value( v ), gradient( g ) {}
+    static dual variable( const T &v, std::size_t i ) {
+      dual r( v );
+      r.gradient[ i ] = T{} + 1;
+      return r;
+    }
+    dual &operator+=( const dual &r ) { return *this = *this + r; }
+    dual &operator-=( const dual &r ) { return *this = *this - r; }
+    dual &operator*=( const dual &r ) { return *this = *this * r; }
+    dual &operator/=( const dual &r ) { return *this = *this / r; }
+    T value;
+    std::array< T, n > gradient;
+  };
+  template< typename T >
+  T get_value( const T &v ) { return v; }
+  template< typename T, std::size_t n >
+  T get_value( const dual< T, n > &v ) { return v.value; }
+  template< typename T >
+  T sign( const T &v ) {
+    return v > T{} ? T{} + 1 : ( v < T{} ? T{} - 1 : T{} );
+  }
+  namespace detail {
+    template< typename T, std::size_t n >
+    dual< T, n > chain( const dual< T, n > &x, const T &value, const T &derivative ) {
+      dual< T, n > r( value );
+      for( std::size_t i = 0u; i != n; ++i ) r.gradient[ i ] = derivative * x.gradient[ i ];
+      return r;
+    }
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > operator-( const dual< T, n > &x ) {
+    dual< T, n > r( -x.value );
+    for( std::size_t i = 0u; i != n; ++i ) r.gradient[ i ] = -x.gradient[ i ];
+    return r;
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > operator+( const dual< T, n > &l, const dual< T, n > &r ) {
+    dual< T, n > v( l.value + r.value );
+    for( std::size_t i = 0u; i != n; ++i ) v.gradient[ i ] = l.gradient[ i ] + r.gradient[ i ];
+    return v;
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > operator-( const dual< T, n > &l, const dual< T, n > &r ) {
+    dual< T, n > v( l.value - r.value );
+    for( std::size_t i = 0u; i != n; ++i ) v.gradient[ i ] = l.gradient[ i ] - r.gradient[ i ];
+    return v;
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > operator*( const dual< T, n > &l, const dual< T, n > &r ) {
+    dual< T, n > v( l.value * r.value );
+    for( std::size_t i = 0u; i != n; ++i ) v.gradient[ i ] = l.gradient[ i ] * r.value + l.value * r.gradient[ i ];
+    return v;
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > operator/( const dual< T, n > &l, const dual< T, n > &r ) {
+    const T inv = ( T{} + 1 ) / r.value;
+    dual< T, n > v( l.value * inv );
+    for( std::size_t i = 0u; i != n; ++i ) v.gradient[ i ] = ( l.gradient[ i ] - v.value * r.gradient[ i ] ) * inv;
+    return v;
+  }
+  template< typename T, std::size_t n, typename U, typename std::enable_if< std::is_arithmetic< U >::value >::type* = nullptr >
+  dual< T, n > operator+( const dual< T, n > &l, U r ) { return dual< T, n >( l.value + r, l.gradient ); }
+  template< typename T, std::size_t n, typename U, typename std::enable_if< std::is_arithmetic< U >::value >::type* = nullptr >
+  dual< T, n > operator+( U l, const dual< T, n > &r ) { return dual< T, n >( l + r.value, r.gradient ); }
+  template< typename T, std::size_t n, typename U, typename std::enable_if< std::is_arithmetic< U >::value >::type* = nullptr >
+  dual< T, n > operator-( const dual< T, n > &l, U r ) { return dual< T, n >( l.value - r, l.gradient ); }
+  template< typename T, std::size_t n, typename U, typename std::enable_if< std::is_arithmetic< U >::value >::type* = nullptr >
+  dual< T, n > operator-( U l, const dual< T, n > &r ) { return -r + l; }
+  template< typename T, std::size_t n, typename U, typename std::enable_if< std::is_arithmetic< U >::value >::type* = nullptr >
+  dual< T, n > operator*( const dual< T, n > &l, U r ) {
+    dual< T, n > v( l.value * r );
+    for( std::size_t i = 0u; i != n; ++i ) v.gradient[ i ] = l.gradient[ i ] * r;
+    return v;
+  }
+  template< typename T, std::size_t n, typename U, typename std::enable_if< std::is_arithmetic< U >::value >::type* = nullptr >
+  dual< T, n > operator*( U l, const dual< T, n > &r ) { return r * l; }
+  template< typename T, std::size_t n, typename U, typename std::enable_if< std::is_arithmetic< U >::value >::type* = nullptr >
+  dual< T, n > operator/( const dual< T, n > &l, U r ) {
+    dual< T, n > v( l.value / r );
+    for( std::size_t i = 0u; i != n; ++i ) v.gradient[ i ] = l.gradient[ i ] / r;
+    return v;
+  }
+  template< typename T, std::size_t n, typename U, typename std::enable_if< std::is_arithmetic< U >::value >::type* = nullptr >
+  dual< T, n > operator/( U l, const dual< T, n > &r ) { return dual< T, n >( T{} + l ) / r; }
+  template< typename T, std::size_t n >
+  dual< T, n > abs( const dual< T, n > &x ) {
+    const T s = sign( x.value );
+    dual< T, n > r( x.value * s );
+    for( std::size_t i = 0u; i != n; ++i ) r.gradient[ i ] = x.gradient[ i ] * s;
+    return r;
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > exp( const dual< T, n > &x ) {
+    const T e = std::exp( x.value );
+    return detail::chain( x, e, e );
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > log( const dual< T, n > &x ) {
+    return detail::chain( x, T( std::log( x.value ) ), T( 1 / x.value ) );
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > sqrt( const dual< T, n > &x ) {
+    const T s = std::sqrt( x.value );
+    return detail::chain( x, s, T( 1 / ( 2 * s ) ) );
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > sin( const dual< T, n > &x ) {
+    return detail::chain( x, T( std::sin( x.value ) ), T( std::cos( x.value ) ) );
+  }
+  template< typename T, std::size_t n >
+  dual< T, n > cos( const dual< T, n > &x ) {
+    return detail::chain( x, T( std::cos( x.value ) ), T( -std::sin( x.value ) ) );
+  }
+}
+
+#endif
@@ -22,12 +22,15 @@ SOFTWARE.
 
 #ifndef IFM_EXP_MATCH_H
 #define IFM_EXP_MATCH_H
+#include <cmath>
 #include <tuple>
 #include "setter.h"
+#include "dual.h"
 #include "fm.h"
+#include "levenberg_marquardt.h"
 namespace ifm {
   std::tuple< float, float >
-  exp_match( const float *expected, unsigned int size, float dt );
+  exp_match( const float *expected, unsigned int size, float dt, float c, fit_solver_t solver = fit_solver_t::adam );
   struct exp_envelope_params_t {
     exp_envelope_params_t() : attack_a( 0 ), attack_b( 0 ), decay_a( 0 ), decay_b( 0 ), highest( 0 ), highest_level( 0 ) {}
     IFM_SET_SMALL_VALUE( attack_a )
@@ -44,13 +47,28 @@ namespace ifm {
     float highest_level;
   };
   exp_envelope_params_t
-  get_attack_and_decay_exp( const float *expected, unsigned int size, float dt, bool damped );
+  get_attack_and_decay_exp( const float *expected, unsigned int size, float dt, bool damped, fit_solver_t solver = fit_solver_t::adam );
   std::pair< envelope_param_keyframe_t< double >, float >
-  get_attack_and_decay( const float *expected, unsigned int size, float dt, bool no_attack, bool no_sustain );
+  get_attack_and_decay( const float *expected, unsigned int size, float dt, bool no_attack, bool no_sustain, fit_solver_t solver = fit_solver_t::adam );
   std::tuple< float, float >
-  approxymate_decay( double a, double b, double length );
+  approxymate_decay( double a, double b, double length, fit_solver_t solver = fit_solver_t::adam );
   float
-  approxymate_attack( double a, double b, double length );
+  approxymate_attack( double a, double b, double length, fit_solver_t solver = fit_solver_t::adam );
+  template< typename T >
+  T exp_envelope( const T &a, const T &b, float x ) {
+    using std::exp;
+    return exp( -x * a ) * ( 1 - b ) + b;
+  }
+  template< typename T >
+  T get_envelope_error( double a, double b, const T &m, const T &n ) {
+    using std::exp;
+    return ((-1+b)*(exp(a*m)*(-2+a*(m-n))+exp(a*n)*(2+a*(m-n))))/(2.*a*exp(a*(m+n)));
+  }
+  template< typename T >
+  T get_sustain_error( double a, double b, const T &m, const T &n ) {
+    using std::exp;
+    return ((-1+b)*(-exp(a*m)+exp(a*n)*(1+a*(m-n))))/(a*exp(a*(m+n)));
+  }
   float get_exp_envelope( float a, float b, float x );
   std::pair< float, float > get_linear_interpolation( float x0, float y0, float x1, float y1 );
   float get_linear_envelope( const envelope_param_keyframe_t< double > &e, float x );
@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_FIT_CACHE_H
+#define IFM_FIT_CACHE_H
+#include <cstdint>
+#include <atomic>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ifm/setter.h"
+#include "ifm/2op.h"
+
+namespace ifm {
+  struct invalid_fit_cache {};
+  struct fit_cache_entry_t {
+    float loss;
+    unsigned int freq;
+    float b;
+  };
+  struct fit_cache_hit_t {
+    fit_cache_entry_t entry;
+    bool exact;
+  };
+  struct fit_cache_config_t {
+    fit_cache_config_t() : resolution( 1.0e-3f ), warm_distance( 2.0e-2f ) {}
+    IFM_SET_SMALL_VALUE( resolution )
+    IFM_SET_SMALL_VALUE( warm_distance )
+    float resolution;
+    float warm_distance;
+  };
+  struct fit_cache_stats_t {
+    unsigned long exact;
+    unsigned long nearest;
+    unsigned long miss;
+  };
+  class fit_cache {
+  public:
+    explicit fit_cache( const fit_cache_config_t &config_ = fit_cache_config_t() );
+    fit_cache( const std::string &filename, const fit_cache_config_t &config_ = fit_cache_config_t() );
+    std::optional< fit_cache_hit_t > find( const float *expected, unsigned int harmony_count, unsigned int context, const fit_config_t &fit_config ) const;
+    void insert( const float *expected, unsigned int harmony_count, unsigned int context, const fit_config_t &fit_config, const fit_cache_entry_t &entry );
+    void save( const std::string &filename ) const;
+    size_t size() const;
+    fit_cache_stats_t get_stats() const;
+  private:
+    struct key_t {
+      uint64_t fingerprint;
+      uint32_t context;
+      std::vector< uint16_t > spectrum;
+      bool operator==( const key_t &r ) const {
+        return fingerprint == r.fingerprint && context == r.context && spectrum == r.spectrum;
+      }
+    };
+    struct key_hash_t {
+      size_t operator()( const key_t &key ) const;
+    };
+    key_t make_key( const float *expected, unsigned int harmony_count, unsigned int context, const fit_config_t &fit_config ) const;
+    fit_cache_config_t config;
+    std::unordered_map< key_t, fit_cache_entry_t, key_hash_t > entries;
+    mutable std::shared_mutex guard;
+    mutable std::atomic< unsigned long > exact;
+    mutable std::atomic< unsigned long > nearest;
+    mutable std::atomic< unsigned long > miss;
+  };
+}
+
+#endif
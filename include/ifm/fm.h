@@ -30,6 +30,11 @@ SOFTWARE.
 #include <algorithm>
 #include <iterator>
 #include <charconv>
+#include <memory>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+#include <bitset>
 #include <boost/container/flat_map.hpp>
 #include <boost/program_options.hpp>
 #include <nlohmann/json.hpp>
@@ -104,6 +109,7 @@ namespace ifm {
   struct invalid_configuration {};
 
   note_number_t parse_note_number( const std::string &v );
+  uint8_t parse_program_number( const std::string &v );
   envelope_param_keyframe_t< double > load_envelope_param_keyframe( const nlohmann::json &v );
   envelope_params_t< double > load_envelope_params( const nlohmann::json &v );
   nlohmann::json store_envelope_param_keyframe( const envelope_param_keyframe_t< double > &v );
@@ -124,12 +130,10 @@ namespace ifm {
     envelope_t(
       const envelope_params_t< U > &params,
       note_number_t note
-    ) {
-      auto h = params.upper_bound( note );
-      auto l = h == params.begin() ? h : std::prev( h );
-      if( l == params.end() ) l = std::prev( params.end() );
-      if( h == params.end() ) h = l;
-      config = interpolate< T >( l->second, h->second, l == h ? T( 0 ) : T( note - l->first )/T( h->first - l->first ) );
+    ) : envelope_t( get_config( params, note ) ) {}
+    envelope_t(
+      const envelope_param_keyframe_t< T > &config_
+    ) : config( config_ ) {
       attack1_tangent = config.attack_mid_level / config.attack1_length / T( synth_sample_rate );
       attack2_tangent = ( 1 - config.attack_mid_level ) / config.attack2_length / T( synth_sample_rate );
       decay1_tangent = -( 1 - config.decay_mid_level ) / config.decay1_length / T( synth_sample_rate );
@@ -173,6 +177,17 @@ namespace ifm {
         state = &envelope_t::end;
     }
     bool is_end() const { return state == &envelope_t::end; }
+    template< typename U >
+    static envelope_param_keyframe_t< T > get_config(
+      const envelope_params_t< U > &params,
+      note_number_t note
+    ) {
+      auto h = params.upper_bound( note );
+      auto l = h == params.begin() ? h : std::prev( h );
+      if( l == params.end() ) l = std::prev( params.end() );
+      if( h == params.end() ) h = l;
+      return interpolate< T >( l->second, h->second, l == h ? T( 0 ) : T( note - l->first )/T( h->first - l->first ) );
+    }
   private:
     void delay( T *dest ) {
       std::fill( dest, dest + synth_block_size, 0 );
@@ -351,6 +366,11 @@ namespace ifm {
     ) : envelope(
       init_envelope( params, note, std::make_index_sequence< oper_count >() )
     ) {}
+    envelopes_t(
+      const std::array< envelope_param_keyframe_t< T >, oper_count > &config
+    ) : envelope(
+      init_envelope( config, std::make_index_sequence< oper_count >() )
+    ) {}
     void operator()( unsigned int operator_index, T *dest ) {
       envelope[ operator_index ]( dest );
     }
@@ -371,6 +391,15 @@ namespace ifm {
         envelope_t< T >( params[ seq ], note )...
       }};
     }
+    template< typename I, I ... seq >
+    static std::array< envelope_t< T >, oper_count > init_envelope(
+      const std::array< envelope_param_keyframe_t< T >, oper_count > &config,
+      std::index_sequence< seq... >
+    ) {
+      return std::array< envelope_t< T >, oper_count >{{
+        envelope_t< T >( config[ seq ] )...
+      }};
+    }
     std::array< envelope_t< T >, oper_count > envelope;
   };
 
@@ -397,7 +426,6 @@ namespace ifm {
     if( v.size() != oper_count * ( oper_count + 1 ) ) throw invalid_configuration {};
     for( unsigned int i = 0; i != oper_count * ( oper_count + 1 ); ++i ) {
       temp[ i ] = v[ i ];
-      ++i;
     }
     return temp;
   }
@@ -431,15 +459,23 @@ namespace ifm {
     weight_t(
       const weight_params_t< U, n > &params,
       note_number_t note
+    ) : config( get_config( params, note ) ) {}
+    weight_t(
+      const weight_param_keyframe_t< T, n > &config_
+    ) : config( config_ ) {}
+    T operator()( unsigned int i ) const {
+      return config[ i ];
+    }
+    template< typename U >
+    static weight_param_keyframe_t< T, n > get_config(
+      const weight_params_t< U, n > &params,
+      note_number_t note
     ) {
       auto h = params.upper_bound( note );
       auto l = h == params.begin() ? h : std::prev( h );
       if( l == params.end() ) l = std::prev( params.end() );
       if( h == params.end() ) h = l;
-      config = interpolate< T >( l->second, h->second, l == h ? T( 0 ) : T( note - l->first )/T( h->first - l->first ) );
-    }
-    T operator()( unsigned int i ) const {
-      return config[ i ];
+      return interpolate< T >( l->second, h->second, l == h ? T( 0 ) : T( note - l->first )/T( h->first - l->first ) );
     }
   private:
     weight_param_keyframe_t< T, n > config;
@@ -466,6 +502,110 @@ namespace ifm {
       .set_weight( load_weight_params< oper_count >( v[ "weight" ] ) );
   }
 
+  template< typename T, unsigned int oper_count >
+  struct fm_note_params_t {
+    std::array< envelope_param_keyframe_t< T >, oper_count > envelope;
+    weight_param_keyframe_t< T, oper_count > weight;
+    std::array< T, oper_count > tangent;
+  };
+
+  template< typename T, unsigned int oper_count, typename U >
+  fm_note_params_t< T, oper_count > get_fm_note_params(
+    const fm_params_t< U, oper_count > &params,
+    note_number_t note
+  ) {
+    fm_note_params_t< T, oper_count > temp;
+    for( unsigned int i = 0; i != oper_count; ++i )
+      temp.envelope[ i ] = envelope_t< T >::get_config( params.envelope[ i ], note );
+    temp.weight = weight_t< T, oper_count >::get_config( params.weight, note );
+    const T base_freq = std::exp2( ( ( T( note ) +  T( 3 ) ) / T( 12 ) ) ) * T( 6.875 );
+    std::transform( params.freq.begin(), params.freq.end(), temp.tangent.begin(), [&]( T v ) { return v * base_freq * T( 2 ) * T( M_PI ) / T( synth_sample_rate ); } );
+    return temp;
+  }
+
+  template< typename T, unsigned int oper_count >
+  using compiled_fm_params_t = std::array< fm_note_params_t< T, oper_count >, max_note_number >;
+
+  template< typename T, unsigned int oper_count, typename U >
+  std::shared_ptr< compiled_fm_params_t< T, oper_count > > compile_fm_params(
+    const fm_params_t< U, oper_count > &params
+  ) {
+    auto temp = std::make_shared< compiled_fm_params_t< T, oper_count > >();
+    for( unsigned int note = 0; note != max_note_number; ++note )
+      ( *temp )[ note ] = get_fm_note_params< T >( params, note_number_t( note ) );
+    return temp;
+  }
+
+  using program_number_t = uint8_t;
+  constexpr unsigned int max_program_number = 128u;
+
+  template< typename T, unsigned int oper_count >
+  class preset_bank_t {
+  public:
+    preset_bank_t() {
+      std::fill( program.begin(), program.end(), 0u );
+    }
+    template< typename U >
+    void add( program_number_t program_number, const fm_params_t< U, oper_count > &params ) {
+      if( program_number >= max_program_number ) throw invalid_configuration {};
+      presets.emplace_back( compile_fm_params< T >( params ) );
+      program[ program_number ] = presets.size() - 1u;
+    }
+    const compiled_fm_params_t< T, oper_count > &operator[]( program_number_t program_number ) const {
+      return *presets[ program[ program_number % max_program_number ] ];
+    }
+    bool empty() const { return presets.empty(); }
+    size_t size() const { return presets.size(); }
+  private:
+    std::vector< std::shared_ptr< const compiled_fm_params_t< T, oper_count > > > presets;
+    std::array< unsigned int, max_program_number > program;
+  };
+
+  template< typename T, unsigned int oper_count >
+  std::shared_ptr< const preset_bank_t< T, oper_count > > load_preset_bank( const nlohmann::json &v ) {
+    auto temp = std::make_shared< preset_bank_t< T, oper_count > >();
+    if( v.find( "envelope" ) != v.end() ) {
+      temp->add( 0u, load_fm_params< oper_count >( v ) );
+      return temp;
+    }
+    for( const auto &[key,value]: v.items() ) {
+      temp->add( parse_program_number( key ), load_fm_params< oper_count >( value ) );
+    }
+    if( temp->empty() ) throw invalid_configuration {};
+    return temp;
+  }
+
+  template< typename T, unsigned int oper_count >
+  std::shared_ptr< const preset_bank_t< T, oper_count > > load_preset_bank( const std::string &path ) {
+    if( !std::filesystem::is_directory( path ) ) {
+      nlohmann::json config;
+      std::ifstream config_file( path );
+      if( !config_file ) throw invalid_configuration {};
+      config_file >> config;
+      return load_preset_bank< T, oper_count >( config );
+    }
+    std::vector< std::pair< unsigned int, std::filesystem::path > > files;
+    for( const auto &entry: std::filesystem::directory_iterator( path ) ) {
+      if( !entry.is_regular_file() || entry.path().extension() != ".json" ) continue;
+      const std::string stem = entry.path().stem().string();
+      unsigned int program_number;
+      auto [ptr, ec] = std::from_chars( stem.data(), stem.data() + stem.size(), program_number );
+      if( ec != std::errc{} || ptr == stem.data() ) continue;
+      if( program_number >= max_program_number ) throw invalid_configuration {};
+      files.emplace_back( program_number, entry.path() );
+    }
+    if( files.empty() ) throw invalid_configuration {};
+    std::sort( files.begin(), files.end() );
+    auto temp = std::make_shared< preset_bank_t< T, oper_count > >();
+    for( const auto &[program_number,filename]: files ) {
+      nlohmann::json config;
+      std::ifstream config_file( filename );
+      config_file >> config;
+      temp->add( program_number, load_fm_params< oper_count >( config ) );
+    }
+    return temp;
+  }
+
   template< typename T, unsigned int oper_count >
   class fm_t {
   public:
@@ -474,10 +614,24 @@ namespace ifm {
       const fm_params_t< U, oper_count > &params,
       note_number_t note,
       velocity_t velocity_ = 128
-    ) : weight( params.weight, note ), envelope( params.envelope, note ), velocity( T( velocity_ )/T(128) ) {
-      const T base_freq = std::exp2( ( ( T( note ) +  T( 3 ) ) / T( 12 ) ) ) * T( 6.875 );
-      std::transform( params.freq.begin(), params.freq.end(), tangent.begin(), [&]( T v ) { return v * base_freq * T( 2 ) * T( M_PI ) / T( synth_sample_rate ); } );
+    ) : fm_t( get_fm_note_params< T >( params, note ), velocity_ ) {}
+    fm_t(
+      const fm_note_params_t< T, oper_count > &params,
+      velocity_t velocity_ = 128,
+      T pitch = 1
+    ) : base_tangent( params.tangent ), weight( params.weight ), envelope( params.envelope ), velocity( T( velocity_ )/T(128) ), gliding( false ) {
+      std::transform( base_tangent.begin(), base_tangent.end(), tangent.begin(), [&]( T v ) { return v * pitch; } );
+      target_tangent = tangent;
+      std::fill( tangent_step.begin(), tangent_step.end(), 0.f );
       std::fill( shift.begin(), shift.end(), 0.f );
+      std::fill( prev.begin(), prev.end(), 0.f );
+    }
+    void set_pitch( T pitch ) {
+      for( unsigned int i = 0; i != oper_count; ++i ) {
+        target_tangent[ i ] = base_tangent[ i ] * pitch;
+        tangent_step[ i ] = ( target_tangent[ i ] - tangent[ i ] ) / T( synth_block_size );
+      }
+      gliding = true;
     }
     template< typename U >
     void operator()( U *dest ) {
@@ -494,9 +648,15 @@ namespace ifm {
           prev[ to_operator_index ] = e[ to_operator_index ][ i ] * std::sin( shift[ to_operator_index ] + drift );
           sum += weight( to_operator_index + oper_count * oper_count ) * prev[ to_operator_index ];
           shift[ to_operator_index ] += tangent[ to_operator_index ];
+          tangent[ to_operator_index ] += tangent_step[ to_operator_index ];
         }
         dest[ i ] = sum * velocity;
       }
+      if( gliding ) {
+        tangent = target_tangent;
+        std::fill( tangent_step.begin(), tangent_step.end(), 0.f );
+        gliding = false;
+      }
     }
     void note_off() {
       envelope.note_off();
@@ -505,25 +665,48 @@ namespace ifm {
       return envelope.is_end();
     }
   private:
+    std::array< T, oper_count > base_tangent;
     std::array< T, oper_count > tangent;
+    std::array< T, oper_count > target_tangent;
+    std::array< T, oper_count > tangent_step;
     std::array< T, oper_count > shift;
     std::array< T, oper_count > prev;
     weight_t< T, oper_count > weight;
     envelopes_t< T, oper_count > envelope;
     T velocity;
+    bool gliding;
   };
   template< typename T, unsigned int oper_count >
   class polyphony_t {
   public:
     polyphony_t(
-      const fm_params_t< double, oper_count > &params_
-    ) : params( params_ ) {}
+      const compiled_fm_params_t< T, oper_count > *params_
+    ) : params( params_ ), pitch( 1 ), sustain( false ) {}
+    void set_params( const compiled_fm_params_t< T, oper_count > *params_ ) {
+      params = params_;
+    }
     void note_on( note_number_t note, velocity_t velocity ) {
+      if( note >= max_note_number ) return;
       active.erase( note );
-      active.insert( std::make_pair( note, fm_t< T, oper_count >( params, note, velocity ) ) );
+      sustained.reset( note );
+      active.insert( std::make_pair( note, fm_t< T, oper_count >( ( *params )[ note ], velocity, pitch ) ) );
     }
     void note_off( note_number_t note ) {
-      active.erase( note );
+      if( note >= max_note_number ) return;
+      if( sustain ) sustained.set( note );
+      else active.erase( note );
+    }
+    void set_pitch( T pitch_ ) {
+      if( pitch == pitch_ ) return;
+      pitch = pitch_;
+      for( auto &v: active ) v.second.set_pitch( pitch );
+    }
+    void set_sustain( bool sustain_ ) {
+      sustain = sustain_;
+      if( sustain || sustained.none() ) return;
+      for( unsigned int note = 0; note != max_note_number; ++note )
+        if( sustained.test( note ) ) active.erase( note );
+      sustained.reset();
     }
     template< typename U >
     void operator()( U *dest ) {
@@ -540,18 +723,41 @@ namespace ifm {
     }
     void reset() {
       active.clear();
+      sustained.reset();
+      sustain = false;
+      pitch = 1;
     }
   private:
-    fm_params_t< double, oper_count > params;
+    const compiled_fm_params_t< T, oper_count > *params;
     std::unordered_map< int, fm_t< T, oper_count > > active;
+    std::bitset< max_note_number > sustained;
+    T pitch;
+    bool sustain;
   };
   template< typename T, unsigned int oper_count >
   class channels_t {
   public:
     channels_t(
       const fm_params_t< double, oper_count > &params
-    ) : scale( 0.8 ), keep( 0 ) {
-      for( unsigned int i = 0; i != 16; ++i ) channels.emplace_back( params );
+    ) : channels_t( make_bank( params ) ) {}
+    channels_t(
+      const std::shared_ptr< const preset_bank_t< T, oper_count > > &bank_
+    ) : bank( bank_ ), scale( 0.8 ), keep( 0 ) {
+      for( unsigned int i = 0; i != 16; ++i ) channels.emplace_back( &( *bank )[ 0 ] );
+      std::fill( gain.begin(), gain.end(), T( 1 ) );
+      std::fill( target_gain.begin(), target_gain.end(), T( 1 ) );
+    }
+    void set_gain( channel_t channel_id, T value ) {
+      target_gain[ channel_id ] = value;
+    }
+    void set_pitch( channel_t channel_id, T value ) {
+      channels[ channel_id ].set_pitch( value );
+    }
+    void set_sustain( channel_t channel_id, bool value ) {
+      channels[ channel_id ].set_sustain( value );
+    }
+    void program_change( channel_t channel_id, program_number_t program ) {
+      channels[ channel_id ].set_params( &( *bank )[ program ] );
     }
     void note_on( channel_t channel_id, note_number_t note, velocity_t velocity ) {
       channels[ channel_id ].note_on( note, velocity );
@@ -563,9 +769,12 @@ namespace ifm {
     void operator()( U *dest ) {
       std::array< U, synth_block_size > b;
       std::fill( dest, dest + synth_block_size, 0 );
-      for( auto &v: channels ) {
-        v( b.data() );
-        for( unsigned int i = 0; i != synth_block_size; ++i ) dest[ i ] += b[ i ] * 0.125f;
+      for( unsigned int channel_id = 0; channel_id != channels.size(); ++channel_id ) {
+        channels[ channel_id ]( b.data() );
+        const T g = gain[ channel_id ];
+        const T dg = ( target_gain[ channel_id ] - g ) / T( synth_block_size );
+        for( unsigned int i = 0; i != synth_block_size; ++i ) dest[ i ] += b[ i ] * ( g + dg * T( i ) ) * 0.125f;
+        gain[ channel_id ] = target_gain[ channel_id ];
       }
       std::array< U, synth_block_size > s;
       auto initial_scale = scale;
@@ -590,9 +799,23 @@ namespace ifm {
     }
     void reset() {
       for( auto &c: channels ) c.reset();
+      std::fill( gain.begin(), gain.end(), T( 1 ) );
+      std::fill( target_gain.begin(), target_gain.end(), T( 1 ) );
+      scale = T( 0.8 );
+      keep = 0;
     }
   private:
+    static std::shared_ptr< const preset_bank_t< T, oper_count > > make_bank(
+      const fm_params_t< double, oper_count > &params
+    ) {
+      auto temp = std::make_shared< preset_bank_t< T, oper_count > >();
+      temp->add( 0u, params );
+      return temp;
+    }
+    std::shared_ptr< const preset_bank_t< T, oper_count > > bank;
     std::vector< polyphony_t< T, oper_count > > channels;
+    std::array< T, 16u > gain;
+    std::array< T, 16u > target_gain;
     T scale;
     int keep;
   };
@@ -0,0 +1,398 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_FM_SPECTRUM_H
+#define IFM_FM_SPECTRUM_H
+#include <cmath>
+#include <array>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <iterator>
+#include <omp.h>
+#include "ifm/setter.h"
+#include "ifm/bessel.h"
+#include "ifm/levenberg_marquardt.h"
+
+namespace ifm {
+  struct invalid_topology {};
+  template< unsigned int oper_count >
+  using fm_topology_t = std::array< float, oper_count * ( oper_count + 1 ) >;
+  template< unsigned int oper_count >
+  struct spectrum_component_t {
+    int freq;
+    float amplitude;
+    std::array< float, oper_count > gradient;
+  };
+  template< unsigned int oper_count >
+  class fm_spectrum {
+  public:
+    using level_t = std::array< float, oper_count >;
+    using ratio_t = std::array< unsigned int, oper_count >;
+    using component_t = spectrum_component_t< oper_count >;
+    fm_spectrum(
+      const fm_topology_t< oper_count > &weight_,
+      const ratio_t &ratio_,
+      unsigned int harmony_count_,
+      float threshold_ = 1.0e-4f
+    ) : weight( weight_ ), ratio( ratio_ ), harmony_count( harmony_count_ ), threshold( threshold_ ) {
+      std::array< unsigned int, oper_count > indegree{};
+      for( unsigned int to = 0u; to != oper_count; ++to )
+        for( unsigned int from = 0u; from != oper_count; ++from )
+          if( weight[ to + from * oper_count ] != 0.f ) {
+            if( to == from ) throw invalid_topology {};
+            ++indegree[ to ];
+          }
+      std::vector< unsigned int > ready;
+      for( unsigned int i = 0u; i != oper_count; ++i )
+        if( indegree[ i ] == 0u ) ready.push_back( i );
+      while( !ready.empty() ) {
+        const unsigned int from = ready.back();
+        ready.pop_back();
+        order.push_back( from );
+        for( unsigned int to = 0u; to != oper_count; ++to )
+          if( weight[ to + from * oper_count ] != 0.f && --indegree[ to ] == 0u )
+            ready.push_back( to );
+      }
+      if( order.size() != oper_count ) throw invalid_topology {};
+    }
+    void operator()( const level_t &level, float *magnitude, level_t *gradient = nullptr ) const {
+      std::array< std::vector< component_t >, oper_count > out;
+      std::vector< component_t > modulation;
+      for( const auto i: order ) {
+        modulation.clear();
+        for( unsigned int from = 0u; from != oper_count; ++from )
+          merge( modulation, out[ from ], weight[ i + from * oper_count ] );
+        out[ i ] = operate( i, level[ i ], modulation );
+      }
+      std::vector< component_t > output;
+      for( unsigned int i = 0u; i != oper_count; ++i )
+        merge( output, out[ i ], weight[ i + oper_count * oper_count ] );
+      std::fill( magnitude, std::next( magnitude, harmony_count ), 0.f );
+      if( gradient ) std::fill( gradient, std::next( gradient, harmony_count ), level_t{} );
+      for( const auto &c: output ) {
+        if( c.freq < 1 || unsigned( c.freq ) > harmony_count ) continue;
+        magnitude[ c.freq - 1 ] = std::abs( c.amplitude );
+        if( gradient )
+          for( unsigned int q = 0u; q != oper_count; ++q )
+            gradient[ c.freq - 1 ][ q ] = c.amplitude < 0.f ? -c.gradient[ q ] : c.gradient[ q ];
+      }
+      float sum = 0.f;
+      level_t dsum{};
+      for( unsigned int h = 0u; h != harmony_count; ++h ) {
+        sum += magnitude[ h ];
+        if( gradient )
+          for( unsigned int q = 0u; q != oper_count; ++q ) dsum[ q ] += gradient[ h ][ q ];
+      }
+      if( sum == 0.f ) return;
+      const float inv_sum = 1.f / sum;
+      for( unsigned int h = 0u; h != harmony_count; ++h ) {
+        if( gradient )
+          for( unsigned int q = 0u; q != oper_count; ++q )
+            gradient[ h ][ q ] = ( gradient[ h ][ q ] - magnitude[ h ] * dsum[ q ] * inv_sum ) * inv_sum;
+        magnitude[ h ] *= inv_sum;
+      }
+    }
+    bool is_modulator( unsigned int i ) const {
+      for( unsigned int to = 0u; to != oper_count; ++to )
+        if( weight[ to + i * oper_count ] != 0.f ) return true;
+      return false;
+    }
+    bool is_carrier( unsigned int i ) const {
+      return weight[ i + oper_count * oper_count ] != 0.f;
+    }
+    const ratio_t &get_ratio() const { return ratio; }
+    unsigned int get_harmony_count() const { return harmony_count; }
+  private:
+    struct series_t {
+      int offset;
+      std::vector< float > value;
+      std::array< std::vector< float >, oper_count > gradient;
+    };
+    static void accumulate( std::vector< component_t > &dense, int freq, float amplitude, const level_t &gradient ) {
+      if( freq == 0 ) return;
+      const float sign = freq < 0 ? -1.f : 1.f;
+      const unsigned int f = unsigned( std::abs( freq ) );
+      if( dense.size() <= f ) {
+        const auto head = dense.size();
+        dense.resize( f + 1u );
+        for( auto i = head; i != dense.size(); ++i ) dense[ i ] = component_t{ int( i ), 0.f, level_t{} };
+      }
+      auto &c = dense[ f ];
+      c.amplitude += sign * amplitude;
+      for( unsigned int q = 0u; q != oper_count; ++q )
+        c.gradient[ q ] += sign * gradient[ q ];
+    }
+    void merge( std::vector< component_t > &dest, const std::vector< component_t > &src, float scale ) const {
+      if( scale == 0.f || src.empty() ) return;
+      std::vector< component_t > dense;
+      for( const auto &c: dest ) accumulate( dense, c.freq, c.amplitude, c.gradient );
+      for( const auto &c: src ) {
+        level_t g;
+        for( unsigned int q = 0u; q != oper_count; ++q ) g[ q ] = c.gradient[ q ] * scale;
+        accumulate( dense, c.freq, c.amplitude * scale, g );
+      }
+      compact( dense, dest );
+    }
+    void compact( const std::vector< component_t > &dense, std::vector< component_t > &dest ) const {
+      dest.clear();
+      for( const auto &c: dense ) {
+        bool significant = std::abs( c.amplitude ) >= threshold * threshold;
+        for( unsigned int q = 0u; q != oper_count && !significant; ++q )
+          significant = std::abs( c.gradient[ q ] ) >= threshold * threshold;
+        if( significant ) dest.push_back( c );
+      }
+    }
+    void trim( series_t &series ) const {
+      const auto significant = [&]( size_t i ) {
+        if( std::abs( series.value[ i ] ) >= threshold ) return true;
+        for( unsigned int q = 0u; q != oper_count; ++q )
+          if( std::abs( series.gradient[ q ][ i ] ) >= threshold ) return true;
+        return false;
+      };
+      size_t head = 0u;
+      size_t tail = series.value.size();
+      while( head != tail && !significant( head ) ) ++head;
+      while( tail != head && !significant( tail - 1u ) ) --tail;
+      series.offset += int( head );
+      series.value = std::vector< float >( std::next( series.value.begin(), head ), std::next( series.value.begin(), tail ) );
+      for( auto &g: series.gradient )
+        g = std::vector< float >( std::next( g.begin(), head ), std::next( g.begin(), tail ) );
+    }
+    std::vector< component_t > operate( unsigned int index, float level, const std::vector< component_t > &modulation ) const {
+      constexpr unsigned int order_margin = 10u;
+      constexpr unsigned int max_order = 96u;
+      std::vector< float > x( modulation.size() );
+      unsigned int count = 2u;
+      for( unsigned int k = 0u; k != modulation.size(); ++k ) {
+        x[ k ] = modulation[ k ].amplitude;
+        count = std::max( count, std::min( max_order, unsigned( std::abs( x[ k ] ) ) + order_margin ) + 2u );
+      }
+      std::vector< float > bessel( modulation.size() * count );
+      if( !modulation.empty() )
+        bessel_kind1_sequence( x.data(), x.size(), count, bessel.data() );
+      std::vector< float > dbessel( count );
+      series_t series;
+      series.offset = 0;
+      series.value.assign( 1u, 1.f );
+      for( auto &g: series.gradient ) g.assign( 1u, 0.f );
+      for( unsigned int k = 0u; k != modulation.size(); ++k ) {
+        const auto &c = modulation[ k ];
+        const float *j = bessel.data() + k * count;
+        dbessel[ 0 ] = -j[ 1 ];
+        for( unsigned int n = 1u; n + 1u < count; ++n )
+          dbessel[ n ] = 0.5f * ( j[ n - 1u ] - j[ n + 1u ] );
+        int limit = 0;
+        for( unsigned int n = 0u; n + 1u < count; ++n )
+          if( std::abs( j[ n ] ) >= threshold || std::abs( dbessel[ n ] ) >= threshold ) limit = int( n );
+        const size_t size = series.value.size();
+        series_t next;
+        next.offset = series.offset - limit * c.freq;
+        const size_t next_size = size + size_t( 2 * limit * c.freq );
+        next.value.assign( next_size, 0.f );
+        for( auto &g: next.gradient ) g.assign( next_size, 0.f );
+        for( int n = -limit; n <= limit; ++n ) {
+          const unsigned int a = unsigned( std::abs( n ) );
+          const float sign = ( n < 0 && a % 2u ) ? -1.f : 1.f;
+          const float jv = sign * j[ a ];
+          const float dv = sign * dbessel[ a ];
+          const size_t shift = size_t( ( n + limit ) * c.freq );
+          float *dest = next.value.data() + shift;
+          const float *src = series.value.data();
+          for( size_t i = 0u; i != size; ++i ) dest[ i ] += src[ i ] * jv;
+          for( unsigned int q = 0u; q != oper_count; ++q ) {
+            float *gdest = next.gradient[ q ].data() + shift;
+            const float *gsrc = series.gradient[ q ].data();
+            const float chain = dv * c.gradient[ q ];
+            for( size_t i = 0u; i != size; ++i ) gdest[ i ] += gsrc[ i ] * jv + src[ i ] * chain;
+          }
+        }
+        trim( next );
+        series = std::move( next );
+      }
+      std::vector< component_t > dense;
+      for( size_t i = 0u; i != series.value.size(); ++i ) {
+        level_t grad;
+        for( unsigned int q = 0u; q != oper_count; ++q ) grad[ q ] = level * series.gradient[ q ][ i ];
+        grad[ index ] += series.value[ i ];
+        accumulate( dense, int( ratio[ index ] ) + series.offset + int( i ), level * series.value[ i ], grad );
+      }
+      std::vector< component_t > result;
+      compact( dense, result );
+      return result;
+    }
+    fm_topology_t< oper_count > weight;
+    ratio_t ratio;
+    unsigned int harmony_count;
+    float threshold;
+    std::vector< unsigned int > order;
+  };
+  struct fm_spectrum_fit_config_t {
+    fm_spectrum_fit_config_t() : max_ratio( 8u ), max_level( 20.f ), threshold( 1.0e-4f ), basin_count( 32u ), max_iteration( 100u ), reweight_count( 5u ), start_levels{ 0.5f, 1.5f, 4.f } {}
+    IFM_SET_SMALL_VALUE( max_ratio )
+    IFM_SET_SMALL_VALUE( max_level )
+    IFM_SET_SMALL_VALUE( threshold )
+    IFM_SET_SMALL_VALUE( basin_count )
+    IFM_SET_SMALL_VALUE( max_iteration )
+    IFM_SET_SMALL_VALUE( reweight_count )
+    IFM_SET_LARGE_VALUE( start_levels )
+    unsigned int max_ratio;
+    float max_level;
+    float threshold;
+    unsigned int basin_count;
+    unsigned int max_iteration;
+    unsigned int reweight_count;
+    std::vector< float > start_levels;
+  };
+  template< unsigned int oper_count >
+  struct fm_spectrum_fit_t {
+    float loss;
+    std::array< unsigned int, oper_count > ratio;
+    std::array< float, oper_count > level;
+  };
+  inline float fm_spectrum_loss( const float *expected, const float *magnitude, unsigned int harmony_count ) {
+    float loss = 0.f;
+    for( unsigned int h = 0u; h != harmony_count; ++h )
+      loss += std::abs( std::abs( expected[ h ] ) - magnitude[ h ] );
+    return loss;
+  }
+  template< unsigned int oper_count >
+  fm_spectrum_fit_t< oper_count > refine_fm_spectrum(
+    const float *expected,
+    const fm_spectrum< oper_count > &spectrum,
+    const std::array< float, oper_count > &initial_level,
+    const fm_spectrum_fit_config_t &config = fm_spectrum_fit_config_t()
+  ) {
+    using level_t = typename fm_spectrum< oper_count >::level_t;
+    constexpr float min_residual = 1.0e-4f;
+    const unsigned int harmony_count = spectrum.get_harmony_count();
+    std::vector< float > magnitude( harmony_count );
+    std::vector< level_t > gradient( harmony_count );
+    std::vector< float > weight( harmony_count );
+    levenberg_marquardt_config_t< float, oper_count > lm_config;
+    lm_config.max_iteration = config.max_iteration;
+    bool anchored = false;
+    for( unsigned int i = 0u; i != oper_count; ++i ) {
+      if( spectrum.is_modulator( i ) ) {
+        lm_config.lower[ i ] = 0.f;
+        lm_config.upper[ i ] = config.max_level;
+      }
+      else if( spectrum.is_carrier( i ) && !anchored ) {
+        lm_config.lower[ i ] = initial_level[ i ];
+        lm_config.upper[ i ] = initial_level[ i ];
+        anchored = true;
+      }
+      else if( spectrum.is_carrier( i ) ) {
+        lm_config.lower[ i ] = 0.f;
+        lm_config.upper[ i ] = config.max_level;
+      }
+      else {
+        lm_config.lower[ i ] = 0.f;
+        lm_config.upper[ i ] = 0.f;
+      }
+    }
+    levenberg_marquardt_result_t< float, oper_count > result{ initial_level, 0.f, 0u, false };
+    for( unsigned int round = 0u; round != std::max( config.reweight_count, 1u ); ++round ) {
+      spectrum( result.x, magnitude.data() );
+      for( unsigned int h = 0u; h != harmony_count; ++h )
+        weight[ h ] = 1.f / std::sqrt( std::max( std::abs( magnitude[ h ] - std::abs( expected[ h ] ) ), min_residual ) );
+      result = levenberg_marquardt(
+        [&]( const level_t &level, normal_equation_t< float, oper_count > &eq ) {
+          spectrum( level, magnitude.data(), gradient.data() );
+          for( unsigned int h = 0u; h != harmony_count; ++h ) {
+            level_t row;
+            for( unsigned int q = 0u; q != oper_count; ++q ) row[ q ] = weight[ h ] * gradient[ h ][ q ];
+            eq( weight[ h ] * ( magnitude[ h ] - std::abs( expected[ h ] ) ), row );
+          }
+        },
+        result.x,
+        lm_config
+      );
+    }
+    spectrum( result.x, magnitude.data() );
+    return fm_spectrum_fit_t< oper_count >{ fm_spectrum_loss( expected, magnitude.data(), harmony_count ), spectrum.get_ratio(), result.x };
+  }
+  template< unsigned int oper_count >
+  fm_spectrum_fit_t< oper_count > fit_fm_spectrum(
+    const float *expected,
+    unsigned int harmony_count,
+    const fm_topology_t< oper_count > &topology,
+    const fm_spectrum_fit_config_t &config = fm_spectrum_fit_config_t()
+  ) {
+    using level_t = std::array< float, oper_count >;
+    using ratio_t = std::array< unsigned int, oper_count >;
+    const fm_spectrum< oper_count > shape( topology, ratio_t{}, harmony_count, config.threshold );
+    std::vector< unsigned int > modulators;
+    std::array< bool, oper_count > used{};
+    for( unsigned int i = 0u; i != oper_count; ++i ) {
+      used[ i ] = shape.is_modulator( i ) || shape.is_carrier( i );
+      if( shape.is_modulator( i ) ) modulators.push_back( i );
+    }
+    std::vector< ratio_t > ratios( 1u, ratio_t{} );
+    for( unsigned int i = 0u; i != oper_count; ++i ) {
+      std::vector< ratio_t > expanded;
+      for( const auto &r: ratios )
+        for( unsigned int v = 1u; v <= ( used[ i ] ? std::max( config.max_ratio, 1u ) : 1u ); ++v ) {
+          auto e = r;
+          e[ i ] = v;
+          expanded.push_back( e );
+        }
+      ratios = std::move( expanded );
+    }
+    std::vector< level_t > starts( 1u, level_t{} );
+    for( unsigned int i = 0u; i != oper_count; ++i )
+      if( used[ i ] && !shape.is_modulator( i ) ) starts[ 0 ][ i ] = 1.f;
+    for( const auto i: modulators ) {
+      std::vector< level_t > expanded;
+      for( const auto &s: starts )
+        for( const auto v: config.start_levels ) {
+          auto e = s;
+          e[ i ] = v;
+          expanded.push_back( e );
+        }
+      starts = std::move( expanded );
+    }
+    std::vector< fm_spectrum_fit_t< oper_count > > candidates( ratios.size() * starts.size() );
+#pragma omp parallel for schedule(dynamic)
+    for( unsigned int r = 0u; r < ratios.size(); ++r ) {
+      const fm_spectrum< oper_count > spectrum( topology, ratios[ r ], harmony_count, config.threshold );
+      std::vector< float > magnitude( harmony_count );
+      for( unsigned int i = 0u; i != starts.size(); ++i ) {
+        spectrum( starts[ i ], magnitude.data() );
+        candidates[ r * starts.size() + i ] = fm_spectrum_fit_t< oper_count >{ fm_spectrum_loss( expected, magnitude.data(), harmony_count ), ratios[ r ], starts[ i ] };
+      }
+    }
+    const unsigned int basin_count = std::min< unsigned int >( std::max( config.basin_count, 1u ), candidates.size() );
+    const auto by_loss = []( const fm_spectrum_fit_t< oper_count > &l, const fm_spectrum_fit_t< oper_count > &r ) { return l.loss < r.loss; };
+    std::partial_sort( candidates.begin(), std::next( candidates.begin(), basin_count ), candidates.end(), by_loss );
+    candidates.resize( basin_count );
+#pragma omp parallel for schedule(dynamic)
+    for( unsigned int i = 0u; i < basin_count; ++i ) {
+      const fm_spectrum< oper_count > spectrum( topology, candidates[ i ].ratio, harmony_count, config.threshold );
+      const auto refined = refine_fm_spectrum< oper_count >( expected, spectrum, candidates[ i ].level, config );
+      if( refined.loss < candidates[ i ].loss ) candidates[ i ] = refined;
+    }
+    return *std::min_element( candidates.begin(), candidates.end(), by_loss );
+  }
+}
+
+#endif
@@ -0,0 +1,163 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_LEVENBERG_MARQUARDT_H
+#define IFM_LEVENBERG_MARQUARDT_H
+#include <cstddef>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+namespace ifm {
+  enum class fit_solver_t {
+    adam,
+    levenberg_marquardt
+  };
+  template< typename T, size_t n >
+  struct normal_equation_t {
+    normal_equation_t() : cost( 0 ), jtj{}, jtr{} {}
+    void operator()( T residual, const std::array< T, n > &jacobian ) {
+      cost += residual * residual;
+      for( unsigned int i = 0; i != n; ++i ) {
+        jtr[ i ] += jacobian[ i ] * residual;
+        for( unsigned int j = 0; j != n; ++j )
+          jtj[ i ][ j ] += jacobian[ i ] * jacobian[ j ];
+      }
+    }
+    T cost;
+    std::array< std::array< T, n >, n > jtj;
+    std::array< T, n > jtr;
+  };
+  template< typename T, size_t n >
+  struct levenberg_marquardt_config_t {
+    levenberg_marquardt_config_t() : max_iteration( 100u ), initial_lambda( 1.0e-3 ), cost_tolerance( 1.0e-12 ), step_tolerance( 1.0e-10 ), gradient_tolerance( 1.0e-12 ) {
+      std::fill( lower.begin(), lower.end(), -std::numeric_limits< T >::infinity() );
+      std::fill( upper.begin(), upper.end(), std::numeric_limits< T >::infinity() );
+    }
+    unsigned int max_iteration;
+    T initial_lambda;
+    T cost_tolerance;
+    T step_tolerance;
+    T gradient_tolerance;
+    std::array< T, n > lower;
+    std::array< T, n > upper;
+  };
+  template< typename T, size_t n >
+  struct levenberg_marquardt_result_t {
+    std::array< T, n > x;
+    T cost;
+    unsigned int iteration;
+    bool converged;
+  };
+  template< typename T, size_t n >
+  bool solve_small_system( std::array< std::array< T, n >, n > a, std::array< T, n > b, std::array< T, n > &x ) {
+    for( unsigned int col = 0; col != n; ++col ) {
+      unsigned int pivot = col;
+      for( unsigned int row = col + 1; row != n; ++row )
+        if( std::abs( a[ row ][ col ] ) > std::abs( a[ pivot ][ col ] ) ) pivot = row;
+      if( a[ pivot ][ col ] == T( 0 ) ) return false;
+      std::swap( a[ col ], a[ pivot ] );
+      std::swap( b[ col ], b[ pivot ] );
+      for( unsigned int row = col + 1; row != n; ++row ) {
+        const T f = a[ row ][ col ] / a[ col ][ col ];
+        for( unsigned int k = col; k != n; ++k ) a[ row ][ k ] -= f * a[ col ][ k ];
+        b[ row ] -= f * b[ col ];
+      }
+    }
+    for( unsigned int row = n; row != 0; --row ) {
+      T sum = b[ row - 1 ];
+      for( unsigned int k = row; k != n; ++k ) sum -= a[ row - 1 ][ k ] * x[ k ];
+      x[ row - 1 ] = sum / a[ row - 1 ][ row - 1 ];
+    }
+    return true;
+  }
+  template< typename T, size_t n, typename F >
+  levenberg_marquardt_result_t< T, n > levenberg_marquardt(
+    F &&f,
+    std::array< T, n > x,
+    const levenberg_marquardt_config_t< T, n > &config = levenberg_marquardt_config_t< T, n >()
+  ) {
+    const auto clamp = [&]( std::array< T, n > &v ) {
+      for( unsigned int i = 0; i != n; ++i )
+        v[ i ] = std::min( std::max( v[ i ], config.lower[ i ] ), config.upper[ i ] );
+    };
+    clamp( x );
+    normal_equation_t< T, n > current;
+    f( x, current );
+    T lambda = config.initial_lambda;
+    levenberg_marquardt_result_t< T, n > result{ x, current.cost, 0u, false };
+    for( ; result.iteration != config.max_iteration; ++result.iteration ) {
+      T gradient = 0;
+      for( unsigned int i = 0; i != n; ++i )
+        gradient = std::max( gradient, std::abs( current.jtr[ i ] ) );
+      if( gradient <= config.gradient_tolerance ) {
+        result.converged = true;
+        break;
+      }
+      T diagonal = std::numeric_limits< T >::epsilon();
+      for( unsigned int i = 0; i != n; ++i )
+        diagonal = std::max( diagonal, current.jtj[ i ][ i ] );
+      auto a = current.jtj;
+      for( unsigned int i = 0; i != n; ++i )
+        a[ i ][ i ] += lambda * diagonal;
+      std::array< T, n > minus_jtr;
+      for( unsigned int i = 0; i != n; ++i ) minus_jtr[ i ] = -current.jtr[ i ];
+      std::array< T, n > delta{};
+      if( !solve_small_system( a, minus_jtr, delta ) ) {
+        lambda *= T( 10 );
+        continue;
+      }
+      auto candidate = x;
+      for( unsigned int i = 0; i != n; ++i ) candidate[ i ] += delta[ i ];
+      clamp( candidate );
+      T step = 0;
+      T scale = 0;
+      for( unsigned int i = 0; i != n; ++i ) {
+        step += ( candidate[ i ] - x[ i ] ) * ( candidate[ i ] - x[ i ] );
+        scale += x[ i ] * x[ i ];
+      }
+      if( std::sqrt( step ) <= config.step_tolerance * ( std::sqrt( scale ) + config.step_tolerance ) ) {
+        result.converged = true;
+        break;
+      }
+      normal_equation_t< T, n > next;
+      f( candidate, next );
+      if( std::isfinite( next.cost ) && next.cost < current.cost ) {
+        const bool settled = current.cost - next.cost <= config.cost_tolerance * current.cost;
+        x = candidate;
+        current = next;
+        lambda = std::max( lambda / T( 10 ), T( 1.0e-12 ) );
+        if( settled ) {
+          ++result.iteration;
+          result.converged = true;
+          break;
+        }
+      }
+      else lambda *= T( 10 );
+    }
+    result.x = x;
+    result.cost = current.cost;
+    return result;
+  }
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_MAPPED_FILE_H
+#define IFM_MAPPED_FILE_H
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace ifm {
+  struct unable_to_map_file {};
+  class mapped_file {
+  public:
+    explicit mapped_file( const std::string &filename );
+    ~mapped_file();
+    mapped_file( const mapped_file& ) = delete;
+    mapped_file &operator=( const mapped_file& ) = delete;
+    const uint8_t *data() const { return head; }
+    size_t size() const { return length; }
+  private:
+    const uint8_t *head;
+    size_t length;
+  };
+}
+
+#endif
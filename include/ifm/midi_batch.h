@@ -0,0 +1,166 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_MIDI_BATCH_H
+#define IFM_MIDI_BATCH_H
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <tuple>
+#include <chrono>
+#include <fstream>
+#include <numeric>
+#include <algorithm>
+#include <filesystem>
+#include <omp.h>
+
+#include "setter.h"
+#include "fm.h"
+#include "midi_sequencer2.h"
+#include "store_monoral.h"
+
+namespace ifm {
+  struct midi_batch_job_t {
+    midi_batch_job_t() : preset( 0u ) {}
+    IFM_SET_LARGE_VALUE( input )
+    IFM_SET_LARGE_VALUE( output )
+    IFM_SET_SMALL_VALUE( preset )
+    std::string input;
+    std::string output;
+    unsigned int preset;
+  };
+  struct midi_batch_result_t {
+    midi_batch_result_t() : succeeded( false ), thread( 0u ), audio_length( 0 ), render_time( 0 ), realtime_factor( 0 ) {}
+    bool succeeded;
+    unsigned int thread;
+    double audio_length;
+    double render_time;
+    double realtime_factor;
+  };
+  struct midi_batch_summary_t {
+    midi_batch_summary_t() : file_count( 0u ), failed_count( 0u ), thread_count( 0u ), audio_length( 0 ), wall_time( 0 ), throughput( 0 ) {}
+    unsigned int file_count;
+    unsigned int failed_count;
+    unsigned int thread_count;
+    double audio_length;
+    double wall_time;
+    double throughput;
+  };
+
+  template< unsigned int oper_count >
+  class midi_batch_renderer {
+  public:
+    midi_batch_renderer(
+      const std::vector< std::shared_ptr< const preset_bank_t< float, oper_count > > > &presets_,
+      unsigned int thread_count_ = 0u,
+      double max_length_ = 3600.0
+    ) :
+      presets( presets_ ),
+      thread_count( thread_count_ ? thread_count_ : unsigned( omp_get_max_threads() ) ),
+      max_length( max_length_ ),
+      workers( thread_count ) {}
+    std::tuple< std::vector< midi_batch_result_t >, midi_batch_summary_t > operator()(
+      const std::vector< midi_batch_job_t > &jobs
+    ) {
+      std::vector< midi_batch_result_t > results( jobs.size() );
+      std::vector< std::pair< std::uintmax_t, unsigned int > > order;
+      order.reserve( jobs.size() );
+      for( unsigned int i = 0u; i != jobs.size(); ++i ) {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size( jobs[ i ].input, ec );
+        order.emplace_back( ec ? std::uintmax_t( 0 ) : size, i );
+      }
+      std::stable_sort( order.begin(), order.end(), []( const auto &l, const auto &r ) { return l.first > r.first; } );
+      const auto t0 = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule( dynamic, 1 ) num_threads( thread_count )
+      for( unsigned int i = 0u; i < order.size(); ++i ) {
+        const unsigned int thread = omp_get_thread_num();
+        const unsigned int index = order[ i ].second;
+        results[ index ].thread = thread;
+        results[ index ].succeeded = render( workers[ thread ], jobs[ index ], results[ index ] );
+      }
+      const auto t1 = std::chrono::steady_clock::now();
+      midi_batch_summary_t summary;
+      summary.file_count = jobs.size();
+      summary.failed_count = std::count_if( results.begin(), results.end(), []( const auto &r ) { return !r.succeeded; } );
+      summary.thread_count = thread_count;
+      summary.audio_length = std::accumulate( results.begin(), results.end(), 0.0, []( double sum, const auto &r ) { return sum + r.audio_length; } );
+      summary.wall_time = std::chrono::duration< double >( t1 - t0 ).count();
+      summary.throughput = summary.wall_time > 0 ? summary.audio_length / summary.wall_time : 0;
+      return std::make_tuple( std::move( results ), summary );
+    }
+  private:
+    using sequencer_t = midi_sequencer< const uint8_t*, oper_count >;
+    struct worker_t {
+      std::vector< std::unique_ptr< sequencer_t > > sequencers;
+      std::vector< uint8_t > midi;
+      std::vector< float > audio;
+    };
+    bool render( worker_t &worker, const midi_batch_job_t &job, midi_batch_result_t &result ) {
+      if( job.preset >= presets.size() ) return false;
+      const auto t0 = std::chrono::steady_clock::now();
+      {
+        std::ifstream file( job.input, std::ifstream::binary|std::ifstream::ate );
+        if( !file ) return false;
+        const auto size = file.tellg();
+        if( size < 0 ) return false;
+        worker.midi.resize( size );
+        file.seekg( 0 );
+        if( !file.read( reinterpret_cast< char* >( worker.midi.data() ), size ) ) return false;
+      }
+      if( worker.sequencers.size() < presets.size() )
+        worker.sequencers.resize( presets.size() );
+      auto &seq = worker.sequencers[ job.preset ];
+      if( !seq ) seq = std::make_unique< sequencer_t >( presets[ job.preset ] );
+      const uint8_t *midi_begin = worker.midi.data();
+      if( !seq->load( midi_begin, std::next( midi_begin, worker.midi.size() ) ) ) return false;
+      const size_t max_samples = size_t( max_length * synth_sample_rate );
+      worker.audio.clear();
+      while( !seq->is_end() && worker.audio.size() < max_samples ) {
+        const size_t offset = worker.audio.size();
+        worker.audio.resize( offset + synth_block_size );
+        ( *seq )( std::next( worker.audio.data(), offset ) );
+      }
+      const auto t1 = std::chrono::steady_clock::now();
+      result.audio_length = double( worker.audio.size() ) / double( synth_sample_rate );
+      result.render_time = std::chrono::duration< double >( t1 - t0 ).count();
+      result.realtime_factor = result.audio_length > 0 ? result.render_time / result.audio_length : 0;
+      if( worker.audio.empty() ) return false;
+      try {
+        store_monoral( job.output, worker.audio, synth_sample_rate, false );
+      }
+      catch( ... ) {
+        return false;
+      }
+      return true;
+    }
+    std::vector< std::shared_ptr< const preset_bank_t< float, oper_count > > > presets;
+    unsigned int thread_count;
+    double max_length;
+    std::vector< worker_t > workers;
+  };
+}
+
+#endif
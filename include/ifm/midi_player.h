@@ -24,6 +24,7 @@ SOFTWARE.
 #define IFM_MIDI_H
 
 #include <array>
+#include <memory>
 
 #include "fm.h"
 #include "channel_state.h"
@@ -33,13 +34,40 @@ namespace ifm {
   class midi_player {
   public:
     midi_player( const fm_params_t< double, oper_count > &params ) :
+      state( &midi_player::waiting_for_event ), channel( 0 ),
       channels{{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }}, cs( params ) {}
+    midi_player( const std::shared_ptr< const preset_bank_t< float, oper_count > > &bank ) :
+      state( &midi_player::waiting_for_event ), channel( 0 ),
+      channels{{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }}, cs( bank ) {}
+    void initialize() {
+      cs.reset();
+      for( unsigned int i = 0; i != channels.size(); ++i ) cs.program_change( i, 0 );
+      std::for_each( channels.begin(), channels.end(), []( channel_state &channel ) { channel.reset(); } );
+      state = &midi_player::waiting_for_event;
+      channel = 0;
+    }
     bool event( uint8_t v ) {
+      if( v >= 0xF8 ) return false;
       if( v < 0x80 ) return (this->*state)( v );
       else return new_event( v );
     }
     template< typename U >
     void operator()( U *dest ) {
+      constexpr float vibrato_depth = 0.5f;
+      constexpr float vibrato_step = 2.f * float( M_PI ) * 5.5f * float( synth_block_size ) / float( synth_sample_rate );
+      for( auto &c: channels ) {
+        cs.set_gain( c.index, c.final_volume );
+        float pitch = c.final_pitch;
+        if( c.modulation > 0.f ) {
+          c.vibrato_phase += vibrato_step;
+          if( c.vibrato_phase > 2.f * float( M_PI ) ) c.vibrato_phase -= 2.f * float( M_PI );
+          pitch += c.modulation * vibrato_depth * std::sin( c.vibrato_phase );
+        }
+        if( pitch != c.applied_pitch ) {
+          c.applied_pitch = pitch;
+          cs.set_pitch( c.index, std::exp2( pitch / 12.f ) );
+        }
+      }
       cs( dest );
     }
   private:
@@ -50,7 +78,7 @@ namespace ifm {
       return false;
     }
     bool note_off_velocity( uint8_t ) {
-      cs.note_off( channel, note_number_t( message_buffer[ 0 ] ) );
+      cs.note_off( channel, note_number_t( message_buffer[ 0 ] - 12 ) );
       state = &midi_player::note_off_key_number;
       return true;
     }
@@ -62,7 +90,8 @@ namespace ifm {
     bool note_on_velocity( uint8_t v ) {
       if( channel != 10 ) {
         const note_number_t scale = note_number_t( message_buffer[ 0 ] - 12 );
-        cs.note_on( channel, scale, velocity_t( v ) );
+        if( v ) cs.note_on( channel, scale, velocity_t( v ) );
+        else cs.note_off( channel, scale );
       }
       state = &midi_player::note_on_key_number;
       return true;
@@ -94,7 +123,8 @@ namespace ifm {
         state = &midi_player::unknown_control;
       return false;
     }
-    bool program_change( uint8_t ) {
+    bool program_change( uint8_t v ) {
+      cs.program_change( channel, program_number_t( v ) );
       state = &midi_player::program_change;
       return true;
     }
@@ -137,6 +167,7 @@ namespace ifm {
     }
     bool set_dumper_pedal( uint8_t v ) { // cc 64
       channels[ channel ].sustain = v >= 64;
+      cs.set_sustain( channel, channels[ channel ].sustain );
       state = &midi_player::control_change_key;
       return true;
     }
@@ -24,6 +24,8 @@ SOFTWARE.
 #define IFM_MIDI_SEQUENCER_H
 
 #include <array>
+#include <limits>
+#include <utility>
 
 #include "midi_player.h"
 
@@ -35,14 +37,14 @@ namespace ifm {
     float ms_to_delta_time;
   };
 
-  template< typename Iterator, unsigned int oper_count >
+  template< typename Iterator, unsigned int oper_count, typename Player = midi_player< oper_count > >
   class track_sequencer {
   public:
     track_sequencer(
-      midi_player< oper_count > *player_
-    ) : player( player_ ), state( nullptr ), next_event_time( std::numeric_limits< uint32_t >::max() ), cur( nullptr ), end( nullptr ) {
+      Player *player_
+    ) : player( player_ ), state( nullptr ), next_event_time( std::numeric_limits< uint32_t >::max() ), cur(), end() {
     }
-    void load( midi_player< oper_count > *player_, sequencer_state *state_, Iterator begin, Iterator end_ ) {
+    void load( Player *player_, sequencer_state *state_, Iterator begin, Iterator end_ ) {
       player = player_; ///
       state = state_;
       cur = begin;
@@ -93,7 +95,7 @@ namespace ifm {
     }
     void sysex( uint8_t ) {
       const uint32_t length = data_length();
-      if( std::distance( cur, end ) <= length )
+      if( std::distance( cur, end ) >= length )
         cur = std::next( cur, length );
       else
         cur = end;
@@ -149,28 +151,30 @@ namespace ifm {
       else
         midi_event( head );
     }
-    midi_player< oper_count > *player;
+    Player *player;
     sequencer_state *state;
     uint32_t next_event_time;
     Iterator cur;
     Iterator end;
   };
 
-  template< typename Iterator, unsigned int oper_count >
+  template< typename Iterator, unsigned int oper_count, typename Player = midi_player< oper_count > >
   class midi_sequencer {
   public:
-    midi_sequencer(
-     const fm_params_t< double, oper_count > &params
-    ) : player( params ) {
-      tracks.resize( 16, track_sequencer< Iterator, oper_count >( &player ) );
+    template< typename ... Args >
+    explicit midi_sequencer(
+      Args&& ... args
+    ) : player( std::forward< Args >( args )... ) {
+      tracks.resize( 16, track_sequencer< Iterator, oper_count, Player >( &player ) );
     }
+    midi_sequencer( const midi_sequencer& ) = delete;
+    midi_sequencer &operator=( const midi_sequencer& ) = delete;
     bool load( Iterator begin, Iterator end ) {
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
+      state.track_count = 0u;
       if( std::distance( begin, end ) < 14 ) return false;
       constexpr static const std::array< uint8_t, 8u > header_magic {{
         'M', 'T', 'h', 'd', 0, 0, 0, 6
       }};
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
       if( !std::equal( header_magic.begin(), header_magic.end(), begin ) ) return false;
       auto cur = std::next( begin, header_magic.size() );
       uint16_t format = *cur;
@@ -178,16 +182,13 @@ namespace ifm {
       format <<= 8;
       format |= *cur;
       ++cur;
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
       if( format >= 2 ) return false;
       uint16_t track_count = *cur;
       ++cur;
       track_count <<= 8;
       track_count |= *cur;
       ++cur;
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
       if( track_count > 16u ) track_count = 16u;
-      state.track_count = track_count;
       uint16_t resolution = *cur;
       ++cur;
       resolution <<= 8;
@@ -195,17 +196,15 @@ namespace ifm {
       ++cur;
       state.resolution = resolution;
       state.ms_to_delta_time = state.resolution * 1000.f / 500000.f;
+      player.initialize();
       constexpr static const std::array< uint8_t, 4u > track_magic {{
         'M', 'T', 'r', 'k'
       }};
       now = 0.f;
       for( unsigned int i = 0u; i != track_count; ++i ) {
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
         if( std::distance( cur, end ) < 4 ) return false;
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
         if( !std::equal( track_magic.begin(), track_magic.end(), cur ) ) return false;
         cur = std::next( cur, track_magic.size() );
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
         if( std::distance( cur, end ) < 4 ) return false;
         uint32_t track_length = *cur;
         ++cur;
@@ -218,13 +217,12 @@ namespace ifm {
         track_length <<= 8;
         track_length |= *cur;
         ++cur;
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
         if( std::distance( cur, end ) < track_length ) return false;
         const auto track_end = std::next( cur, track_length );
         tracks[ i ].load( &player, &state, cur, track_end );
+        ++state.track_count;
         cur = track_end;
       }
-      std::cout << __FILE__ << " " << __LINE__ << std::endl;
       return true;
     }
     template< typename U >
@@ -234,13 +232,18 @@ namespace ifm {
       player( dest );
       now += float(synth_block_size) / float(synth_sample_rate) * 1000.f * state.ms_to_delta_time;
     }
+    void dispatch_all() {
+      for( unsigned int i = 0u; i != state.track_count; ++i )
+        tracks[ i ]( std::numeric_limits< uint32_t >::max() - 1u );
+    }
+    const Player &get_player() const { return player; }
     bool is_end() {
       return std::find_if( tracks.begin(), std::next( tracks.begin(), state.track_count ), []( const auto &t ) { return !t.is_end(); } ) == std::next( tracks.begin(), state.track_count );
     }
   private:
-    midi_player< oper_count > player;
+    Player player;
     sequencer_state state;
-    std::vector< track_sequencer< Iterator, oper_count > > tracks;
+    std::vector< track_sequencer< Iterator, oper_count, Player > > tracks;
     float now;
   };
 }
@@ -0,0 +1,215 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_MIDI_STREAM_H
+#define IFM_MIDI_STREAM_H
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <poll.h>
+#include <unistd.h>
+
+#include "fm.h"
+#include "midi_player.h"
+
+namespace ifm {
+  struct midi_message_t {
+    midi_message_t() : length( 0u ) {}
+    std::chrono::steady_clock::time_point time;
+    std::array< uint8_t, 3u > data;
+    uint8_t length;
+  };
+
+  class midi_stream_parser {
+  public:
+    midi_stream_parser() : running_status( 0u ), expected( 0u ), received( 0u ), discard( false ) {}
+    template< typename F >
+    void operator()( uint8_t v, F &&emit ) {
+      if( v >= 0xF8 ) return;
+      if( v >= 0xF0 ) {
+        running_status = 0u;
+        message.length = 0u;
+        received = 0u;
+        discard = true;
+        if( v == 0xF1 || v == 0xF3 ) expected = 1u;
+        else if( v == 0xF2 ) expected = 2u;
+        else if( v == 0xF0 ) expected = std::numeric_limits< uint8_t >::max();
+        else {
+          expected = 0u;
+          discard = false;
+        }
+        return;
+      }
+      if( v >= 0x80 ) {
+        running_status = v;
+        expected = ( ( v & 0xF0 ) == 0xC0 || ( v & 0xF0 ) == 0xD0 ) ? 1u : 2u;
+        received = 0u;
+        discard = false;
+        return;
+      }
+      if( discard ) {
+        if( expected != std::numeric_limits< uint8_t >::max() && ++received == expected ) {
+          discard = false;
+          expected = 0u;
+        }
+        return;
+      }
+      if( !running_status ) return;
+      message.data[ 0 ] = running_status;
+      message.data[ ++received ] = v;
+      if( received == expected ) {
+        message.length = expected + 1u;
+        emit( message );
+        received = 0u;
+      }
+    }
+    void reset() {
+      running_status = 0u;
+      expected = 0u;
+      received = 0u;
+      discard = false;
+    }
+  private:
+    midi_message_t message;
+    uint8_t running_status;
+    uint8_t expected;
+    uint8_t received;
+    bool discard;
+  };
+
+  template< typename T, size_t capacity >
+  class spsc_queue {
+  public:
+    spsc_queue() : head( 0u ), tail( 0u ) {}
+    bool push( const T &v ) {
+      const size_t t = tail.load( std::memory_order_relaxed );
+      const size_t next = ( t + 1u ) % capacity;
+      if( next == head.load( std::memory_order_acquire ) ) return false;
+      buffer[ t ] = v;
+      tail.store( next, std::memory_order_release );
+      return true;
+    }
+    const T *front() const {
+      const size_t h = head.load( std::memory_order_relaxed );
+      if( h == tail.load( std::memory_order_acquire ) ) return nullptr;
+      return &buffer[ h ];
+    }
+    void pop() {
+      head.store( ( head.load( std::memory_order_relaxed ) + 1u ) % capacity, std::memory_order_release );
+    }
+    bool empty() const {
+      return head.load( std::memory_order_acquire ) == tail.load( std::memory_order_acquire );
+    }
+  private:
+    std::array< T, capacity > buffer;
+    alignas( 64 ) std::atomic< size_t > head;
+    alignas( 64 ) std::atomic< size_t > tail;
+  };
+
+  template< unsigned int oper_count >
+  class midi_stream_player {
+  public:
+    midi_stream_player(
+      const std::shared_ptr< const preset_bank_t< float, oper_count > > &bank,
+      std::chrono::microseconds latency_ = std::chrono::milliseconds( 5 )
+    ) : player( bank ), latency( latency_ ), fd( -1 ), block_count( 0u ), running( false ), finished( true ), dropped( 0u ) {}
+    ~midi_stream_player() {
+      stop();
+    }
+    midi_stream_player( const midi_stream_player& ) = delete;
+    midi_stream_player &operator=( const midi_stream_player& ) = delete;
+    void start( int fd_ ) {
+      stop();
+      fd = fd_;
+      parser.reset();
+      block_count = 0u;
+      begin = std::chrono::steady_clock::now();
+      finished = false;
+      running = true;
+      input = std::thread( [this]() { input_loop(); } );
+    }
+    void stop() {
+      running = false;
+      if( input.joinable() ) input.join();
+    }
+    template< typename U >
+    void operator()( U *dest ) {
+      ++block_count;
+      const auto block_end = begin + std::chrono::duration_cast< std::chrono::steady_clock::duration >(
+        std::chrono::duration< double >( double( block_count * synth_block_size ) / double( synth_sample_rate ) )
+      );
+      while( const midi_message_t *message = queue.front() ) {
+        if( message->time + latency > block_end ) break;
+        for( unsigned int i = 0u; i != message->length; ++i )
+          player.event( message->data[ i ] );
+        queue.pop();
+      }
+      player( dest );
+    }
+    bool is_end() const {
+      return finished && queue.empty();
+    }
+    size_t get_dropped() const {
+      return dropped;
+    }
+  private:
+    void input_loop() {
+      std::array< uint8_t, 256u > buffer;
+      pollfd p;
+      p.fd = fd;
+      p.events = POLLIN;
+      while( running ) {
+        p.revents = 0;
+        const int ready = poll( &p, 1, 10 );
+        if( ready < 0 ) break;
+        if( ready == 0 ) continue;
+        const ssize_t size = read( fd, buffer.data(), buffer.size() );
+        if( size <= 0 ) break;
+        const auto now = std::chrono::steady_clock::now();
+        for( ssize_t i = 0; i != size; ++i ) {
+          parser( buffer[ i ], [&]( midi_message_t message ) {
+            message.time = now;
+            if( !queue.push( message ) ) ++dropped;
+          } );
+        }
+      }
+      finished = true;
+    }
+    midi_player< oper_count > player;
+    midi_stream_parser parser;
+    spsc_queue< midi_message_t, 4096u > queue;
+    std::chrono::microseconds latency;
+    int fd;
+    std::chrono::steady_clock::time_point begin;
+    uint64_t block_count;
+    std::atomic< bool > running;
+    std::atomic< bool > finished;
+    std::atomic< size_t > dropped;
+    std::thread input;
+  };
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IFM_SIDEBAND_H
+#define IFM_SIDEBAND_H
+#include <vector>
+#include <cstdint>
+
+namespace ifm {
+  struct invalid_sideband_ratio {};
+  struct sideband_t {
+    unsigned int harmony;
+    unsigned int order;
+    float sign;
+  };
+  class sideband_kernel {
+  public:
+    sideband_kernel( unsigned int carrier, unsigned int modulator, unsigned int harmony_count );
+    void operator()( float b, float *magnitude, float *gradient = nullptr ) const;
+    void operator()( const float *b, unsigned int b_count, float *magnitude, float *gradient = nullptr ) const;
+    bool is_reachable( unsigned int harmony ) const { return reachable[ harmony ]; }
+    const std::vector< sideband_t > &get_sidebands() const { return sidebands; }
+    unsigned int get_carrier() const { return carrier; }
+    unsigned int get_modulator() const { return modulator; }
+    unsigned int get_harmony_count() const { return harmony_count; }
+    unsigned int get_order_count() const { return order_count; }
+  private:
+    void accumulate( const float *bessel, const float *dbessel, float *magnitude, float *gradient ) const;
+    unsigned int carrier;
+    unsigned int modulator;
+    unsigned int harmony_count;
+    unsigned int order_count;
+    std::vector< sideband_t > sidebands;
+    std::vector< std::uint8_t > reachable;
+  };
+}
+
+#endif
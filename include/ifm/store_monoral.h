@@ -25,5 +25,6 @@ SOFTWARE.
 #include <vector>
 namespace ifm {
 void store_monoral( const std::string &filename, const std::vector< float > &samples, unsigned int sample_rate );
+void store_monoral( const std::string &filename, const std::vector< float > &samples, unsigned int sample_rate, bool norm );
 }
 #endif
@@ -23,194 +23,561 @@ SOFTWARE.
 #include <cstdint>
 #include <cmath>
 #include <array>
-#include <iostream>
-#include <fstream>
+#include <vector>
+#include <limits>
 #include <algorithm>
 #include <iterator>
+#include <numeric>
+#include <atomic>
 #include <omp.h>
-#include "ifm/bessel.h"
 #include "ifm/adam.h"
+#include "ifm/sideband.h"
 #include "ifm/2op.h"
+#include "ifm/fit_cache.h"
 namespace ifm {
   std::tuple< float, float > lossimage(
     const float *expected,
-    const std::vector< std::pair< float, float > > &pre,
-    unsigned int,
-    float b,
-    const std::array< int, max_harmony > &n
+    const sideband_kernel &kernel,
+    float b
   ) {
-    constexpr float a = 1;
-    std::array< float, max_harmony + 3 > bessel{ 0 };
-    std::array< float, max_harmony > generated{ 0 };
-    float l1 = 0;
-    float l2 = 0;
-    for( unsigned int i = 0; i < ( max_harmony + 3 ); ++i ) {
-      bessel[ i ] = ifm::bessel_kind1_approx_2019( b, i, l1, l2, pre );
-      l2 = l1;
-      l1 = bessel[ i ];
-    }
-    float bscale = 0;
-    for( unsigned int i = 0; i != max_harmony; ++i ) {
-      bscale += std::abs( bessel[ i ] );
-      if( i < max_harmony - 2 ) bscale += std::abs( bessel[ i + 2 ] );
-    }
-    //float dbscale = 0.5 * ( bessel[ 0 ] - bessel[ 2 ] ) + bessel[ 2 ] - bessel[ max_harmony - 4 ] - bessel[ max_harmony - 3 ] + 0.5 * ( bessel[ max_harmony - 4 ] - bessel[ max_harmony - 2 ] ) + 0.5 * ( bessel[ max_harmony - 3 ] - bessel[ max_harmony - 1 ] );
-    for( unsigned int i = 0; i != max_harmony - 2; ++i ) {
-      if( n[ i ] != -1 ) generated[ i ] = a * bessel[ n[ i ] ]/bscale;
-      else generated[ i ] = 0;
-      if( i < max_harmony - 2 && n[ i + 2 ] != -1 )
-        generated[ i ] += a * bessel[ n[ i + 2 ] ]/bscale;
-    }
-    float loss = 0;
-    float d = 0;
-    for( unsigned int i = 0; i != max_harmony; ++i ) {
-      if( n[ i ] != -1 ) {
-        float e2 = std::sqrt( expected[ i ] * expected[ i ] );
-          float g2 = std::sqrt( generated[ i ] * generated[ i ] );
-          float s = e2 - g2;
-          loss += std::sqrt( s * s );
-          d += std::sqrt( s * s );
-      }
-      else {
-        float e2 = std::sqrt( expected[ i ] * expected[ i ] );
-        loss += e2;
-      }
-    }
-    return std::make_tuple( loss, d );
+    std::vector< float > magnitude( kernel.get_harmony_count() );
+    kernel( b, magnitude.data() );
+    return lossimage( expected, kernel, magnitude.data() );
   }
 
-  std::tuple< float, float > find_b_2op(
+  std::tuple< float, float > lossimage(
     const float *expected,
-    const std::vector< std::pair< float, float > > &pre,
-    unsigned int,
-    float b,
-    const std::array< int, max_harmony > &n
+    const sideband_kernel &kernel,
+    const float *magnitude
   ) {
-    constexpr float a = 1;
-    std::array< float, max_harmony + 3 > bessel{ 0 };
-    std::array< float, max_harmony > generated{ 0 };
-    float loss = 0;
-    ifm::adam< float > bopt( 0.001, 0.9, 0.999 );
-    for( unsigned int cycle = 0; cycle != 50000; ++cycle ) {
-      float l1 = 0;
-      float l2 = 0;
-      for( unsigned int i = 0; i < ( max_harmony + 3 ); ++i ) {
-        bessel[ i ] = ifm::bessel_kind1_approx_2019( b, i, l1, l2, pre );
-        l2 = l1;
-        l1 = bessel[ i ];
-      }
-      float bscale = 0;
-      for( unsigned int i = 0; i != max_harmony; ++i ) {
-        bscale += std::abs( bessel[ i ] );
-        if( i < max_harmony - 2 ) bscale += std::abs( bessel[ i + 2 ] );
-      }
-      float dbscale = 0.5 * ( bessel[ 0 ] - bessel[ 2 ] ) + bessel[ 2 ] - bessel[ max_harmony - 4 ] - bessel[ max_harmony - 3 ] + 0.5 * ( bessel[ max_harmony - 4 ] - bessel[ max_harmony - 2 ] ) + 0.5 * ( bessel[ max_harmony - 3 ] - bessel[ max_harmony - 1 ] );
-      for( unsigned int i = 0; i != max_harmony - 2; ++i ) {
-        if( n[ i ] != -1 ) generated[ i ] = a * bessel[ n[ i ] ]/bscale;
-        else generated[ i ] = 0;
-        if( i < max_harmony - 2 && n[ i + 2 ] != -1 )
-          generated[ i ] += a * bessel[ n[ i + 2 ] ]/bscale;
-      }
-      float grad_b = 0;
-      loss = 0;
-      for( unsigned int i = 0; i != max_harmony; ++i ) {
-      if( n[ i ] != -1 ) {
-        float e2 = std::sqrt( expected[ i ] * expected[ i ] );
-          float g2 = std::sqrt( generated[ i ] * generated[ i ] );
-          float s = e2 - g2;
-          loss += std::sqrt( s * s );
-          std::array< float, 5 > j{
-            bessel[ n[ i ] - 1 ],
-            bessel[ n[ i ] ],
-            bessel[ n[ i ] + 1 ],
-            bessel[ n[ i ] + 2 ],
-            bessel[ n[ i ] + 3 ]
-          };
-          float j13 = j[1]+j[3];
-          float aaj13 = j13*j13;
-          float grad_b_b1 = e2-std::sqrt(aaj13/(bscale*bscale));
-          if( grad_b_b1 != 0 ) {
-            if( aaj13 > 1.0e-20 ) {
-              /*float aaj13s = aaj13/(bscale*bscale);
-              float aaj13sr = std::sqrt( aaj13s );
-              float grad_b_b12 = grad_b_b1*grad_b_b1;
-              float grad_b_b12r = std::sqrt( grad_b_b12 );
-              float bs3 = bscale*bscale*bscale;*/
-              float grad_b__ = (0.5*j13*
-               (e2 - std::sqrt(aaj13/(bscale*bscale)))*
-               ((-j[0] + j[4])*bscale + 
-                (2.*j[1] + 2.*j[3])*dbscale))/
-                (std::sqrt(grad_b_b1*grad_b_b1)*std::sqrt(aaj13/(bscale*bscale))*
-                 (bscale*bscale*bscale));
-              /*float grad_b_ = (0.5*aaj13*(e2-aaj13sr)*
-               ((-j[0]+j[4])*bscale+(2*j[1]+2*j[3])*dbscale))/
-              (grad_b_b12r*aaj13sr*bs3);*/
+    return spectrum_loss( expected, kernel, magnitude );
+  }
 
-              grad_b += grad_b__;
-            }
+  const char *to_string( fit_stop_reason_t reason ) {
+    switch( reason ) {
+      case fit_stop_reason_t::iteration_limit: return "iteration_limit";
+      case fit_stop_reason_t::loss_converged: return "loss_converged";
+      case fit_stop_reason_t::gradient_converged: return "gradient_converged";
+      case fit_stop_reason_t::step_converged: return "step_converged";
+      case fit_stop_reason_t::pruned: return "pruned";
+    }
+    return "unknown";
+  }
+  namespace {
+    constexpr unsigned int loss_lanes = 16u;
+    using loss_vector_t = float __attribute__((vector_size( loss_lanes * sizeof( float ) )));
+  }
+  void lossimage(
+    const float *expected,
+    const sideband_kernel &kernel,
+    const float *b,
+    unsigned int b_count,
+    float *loss,
+    float *gradient
+  ) {
+    const unsigned int harmony_count = kernel.get_harmony_count();
+    thread_local std::vector< float > magnitude;
+    thread_local std::vector< float > dmagnitude;
+    magnitude.resize( size_t( b_count ) * harmony_count );
+    if( gradient ) dmagnitude.resize( size_t( b_count ) * harmony_count );
+    kernel( b, b_count, magnitude.data(), gradient ? dmagnitude.data() : nullptr );
+    thread_local std::vector< dual< loss_vector_t > > lanes;
+    lanes.resize( harmony_count );
+    for( unsigned int head = 0; head < b_count; head += loss_lanes ) {
+      const unsigned int lanes_count = std::min( loss_lanes, b_count - head );
+      for( unsigned int h = 0; h != harmony_count; ++h ) {
+        lanes[ h ] = dual< loss_vector_t >();
+        for( unsigned int i = 0; i != lanes_count; ++i ) {
+          lanes[ h ].value[ i ] = magnitude[ size_t( head + i ) * harmony_count + h ];
+          if( gradient ) lanes[ h ].gradient[ 0 ][ i ] = dmagnitude[ size_t( head + i ) * harmony_count + h ];
+        }
+      }
+      const auto [l,d] = spectrum_loss( expected, kernel, lanes.data() );
+      for( unsigned int i = 0; i != lanes_count; ++i ) {
+        loss[ head + i ] = l.value[ i ];
+        if( gradient ) gradient[ head + i ] = l.gradient[ 0 ][ i ];
+      }
+    }
+  }
+  void lossimage(
+    const float *expected,
+    const std::vector< sideband_kernel > &kernels,
+    const float *b,
+    unsigned int b_count,
+    float *loss,
+    float *gradient
+  ) {
+#pragma omp parallel for
+    for( unsigned int k = 0; k < kernels.size(); ++k )
+      lossimage( expected, kernels[ k ], b, b_count, loss + size_t( k ) * b_count, gradient ? gradient + size_t( k ) * b_count : nullptr );
+  }
+  float loss_lower_bound(
+    const float *expected,
+    const sideband_kernel &kernel
+  ) {
+    float unreachable = 0.f;
+    float reachable = 0.f;
+    for( unsigned int h = 0; h != kernel.get_harmony_count(); ++h ) {
+      if( kernel.is_reachable( h ) ) reachable += std::abs( expected[ h ] );
+      else unreachable += std::abs( expected[ h ] );
+    }
+    return unreachable + std::abs( reachable - 1.f );
+  }
+  namespace {
+    class shared_best_t {
+    public:
+      shared_best_t() : loss( std::numeric_limits< float >::max() ) {}
+      float get() const {
+        return loss.load( std::memory_order_relaxed );
+      }
+      void update( float l ) {
+        float current = get();
+        while( l < current && !loss.compare_exchange_weak( current, l, std::memory_order_relaxed ) );
+      }
+    private:
+      std::atomic< float > loss;
+    };
+    std::tuple< float, float > find_b_2op_levenberg_marquardt(
+      const float *expected,
+      const sideband_kernel &kernel,
+      const float *initial_b,
+      unsigned int initial_b_count,
+      const fit_config_t &config,
+      std::vector< fit_stats_t > *stats,
+      shared_best_t *shared_best
+    ) {
+      const unsigned int harmony_count = kernel.get_harmony_count();
+      const float bound = shared_best ? loss_lower_bound( expected, kernel ) : 0.f;
+      std::vector< float > magnitude( harmony_count );
+      std::vector< float > gradient( harmony_count );
+      levenberg_marquardt_config_t< float, 1u > lm_config;
+      lm_config.max_iteration = config.max_iteration;
+      lm_config.cost_tolerance = config.loss_tolerance;
+      lm_config.step_tolerance = config.step_tolerance;
+      lm_config.gradient_tolerance = config.gradient_tolerance;
+      lm_config.lower[ 0 ] = 0.f;
+      float best_loss = std::numeric_limits< float >::max();
+      float best_b = 0.f;
+      constexpr unsigned int reweight_count = 5u;
+      constexpr float min_residual = 1.0e-4f;
+      std::vector< float > weight( harmony_count );
+      for( unsigned int i = 0; i != initial_b_count; ++i ) {
+        if( shared_best && bound > shared_best->get() ) {
+          if( stats ) {
+            fit_stats_t s;
+            s.freq = kernel.get_modulator();
+            s.initial_b = initial_b[ i ];
+            s.final_loss = std::numeric_limits< float >::max();
+            s.reason = fit_stop_reason_t::pruned;
+            stats->push_back( s );
           }
+          continue;
+        }
+        levenberg_marquardt_result_t< float, 1u > result{ { initial_b[ i ] }, 0.f, 0u, false };
+        unsigned int iteration = 0u;
+        for( unsigned int round = 0; round != reweight_count; ++round ) {
+          kernel( result.x[ 0 ], magnitude.data() );
+          for( unsigned int h = 0; h != harmony_count; ++h )
+            weight[ h ] = 1.f / std::sqrt( std::max( std::abs( magnitude[ h ] - std::abs( expected[ h ] ) ), min_residual ) );
+          result = levenberg_marquardt(
+            [&]( const std::array< float, 1u > &b, normal_equation_t< float, 1u > &eq ) {
+              kernel( b[ 0 ], magnitude.data(), gradient.data() );
+              for( unsigned int h = 0; h != harmony_count; ++h )
+                if( kernel.is_reachable( h ) )
+                  eq( weight[ h ] * ( magnitude[ h ] - std::abs( expected[ h ] ) ), { weight[ h ] * gradient[ h ] } );
+            },
+            result.x,
+            lm_config
+          );
+          iteration += result.iteration;
+        }
+        result.iteration = iteration;
+        const float loss = std::get< 0 >( lossimage( expected, kernel, result.x[ 0 ] ) );
+        if( shared_best ) shared_best->update( loss );
+        if( stats ) {
+          fit_stats_t s;
+          s.freq = kernel.get_modulator();
+          s.initial_b = initial_b[ i ];
+          s.iteration = result.iteration;
+          s.initial_loss = std::get< 0 >( lossimage( expected, kernel, initial_b[ i ] ) );
+          s.final_loss = loss;
+          s.reason = result.converged ? fit_stop_reason_t::step_converged : fit_stop_reason_t::iteration_limit;
+          stats->push_back( s );
+        }
+        if( loss < best_loss ) {
+          best_loss = loss;
+          best_b = result.x[ 0 ];
+        }
+      }
+      return std::make_tuple( best_loss, best_b );
+    }
+    std::tuple< float, float > find_b_2op_chains(
+      const float *expected,
+      const sideband_kernel &kernel,
+      const float *initial_b,
+      unsigned int initial_b_count,
+      const fit_config_t &config,
+      std::vector< fit_stats_t > *stats,
+      shared_best_t *shared_best
+    ) {
+      if( config.solver == fit_solver_t::levenberg_marquardt )
+        return find_b_2op_levenberg_marquardt( expected, kernel, initial_b, initial_b_count, config, stats, shared_best );
+      const float bound = shared_best ? loss_lower_bound( expected, kernel ) : 0.f;
+      struct run_t {
+        run_t( float b_, float learning_rate ) :
+          b( b_ ), best_b( b_ ), best_loss( std::numeric_limits< float >::max() ), stall( 0u ), still( 0u ),
+          opt( learning_rate, 0.9, 0.999 ) {}
+        float b;
+        float best_b;
+        float best_loss;
+        unsigned int stall;
+        unsigned int still;
+        ifm::adam< float > opt;
+        fit_stats_t stats;
+      };
+      const unsigned int harmony_count = kernel.get_harmony_count();
+      std::vector< run_t > runs;
+      runs.reserve( initial_b_count );
+      for( unsigned int i = 0; i != initial_b_count; ++i ) {
+        runs.emplace_back( initial_b[ i ], config.learning_rate );
+        runs.back().stats.freq = kernel.get_modulator();
+        runs.back().stats.initial_b = initial_b[ i ];
+      }
+      std::vector< unsigned int > active( initial_b_count );
+      std::iota( active.begin(), active.end(), 0u );
+      std::vector< float > b( initial_b_count );
+      std::vector< float > magnitude( initial_b_count * harmony_count );
+      std::vector< float > gradient( initial_b_count * harmony_count );
+      std::vector< dual< float > > run_magnitude( harmony_count );
+      for( unsigned int cycle = 0; cycle != config.max_iteration && !active.empty(); ++cycle ) {
+        if( shared_best && bound > shared_best->get() ) {
+          for( const auto i: active ) runs[ i ].stats.reason = fit_stop_reason_t::pruned;
+          break;
         }
-        else {
-          float e2 = std::sqrt( expected[ i ] * expected[ i ] );
-          loss += e2;
+        for( unsigned int i = 0; i != active.size(); ++i )
+          b[ i ] = runs[ active[ i ] ].b;
+        kernel( b.data(), active.size(), magnitude.data(), gradient.data() );
+        unsigned int remaining = 0;
+        for( unsigned int i = 0; i != active.size(); ++i ) {
+          auto &run = runs[ active[ i ] ];
+          for( unsigned int h = 0; h != harmony_count; ++h )
+            run_magnitude[ h ] = dual< float >( magnitude[ i * harmony_count + h ], { gradient[ i * harmony_count + h ] } );
+          const auto [loss,d] = spectrum_loss( expected, kernel, run_magnitude.data() );
+          const float l = loss.value;
+          const float grad_b = loss.gradient[ 0 ];
+          if( cycle == 0 ) run.stats.initial_loss = l;
+          run.stats.iteration = cycle + 1;
+          if( run.best_loss - l > config.loss_tolerance ) run.stall = 0;
+          else ++run.stall;
+          if( l < run.best_loss ) {
+            run.best_loss = l;
+            run.best_b = run.b;
+            if( shared_best ) shared_best->update( l );
+          }
+          const float step = run.opt( grad_b );
+          run.b = std::max( run.b - step, 0.f );
+          if( std::abs( step ) < config.step_tolerance ) ++run.still;
+          else run.still = 0;
+          if( std::abs( grad_b ) < config.gradient_tolerance )
+            run.stats.reason = fit_stop_reason_t::gradient_converged;
+          else if( run.stall >= config.patience )
+            run.stats.reason = fit_stop_reason_t::loss_converged;
+          else if( run.still >= config.patience )
+            run.stats.reason = fit_stop_reason_t::step_converged;
+          else active[ remaining++ ] = active[ i ];
         }
+        active.resize( remaining );
       }
-      float diff = bopt( grad_b );
-      b -= diff;
-      b = std::max( b, 0.f );
+      for( auto &run: runs ) run.stats.final_loss = run.best_loss;
+      if( stats )
+        for( const auto &run: runs ) stats->push_back( run.stats );
+      if( runs.empty() ) return std::make_tuple( std::numeric_limits< float >::max(), 0.f );
+      const auto best = std::min_element( runs.begin(), runs.end(), []( const run_t &l, const run_t &r ) { return l.best_loss < r.best_loss; } );
+      return std::make_tuple( best->best_loss, best->best_b );
     }
-    return std::make_tuple( loss, b );
+    constexpr std::array< float, 5u > restart_b{ 0.f, 1.f, 2.f, 3.f, 4.f };
   }
-  std::array< int, max_harmony > generate_n(
-    unsigned int freq
+  std::tuple< float, float > find_b_2op(
+    const float *expected,
+    const sideband_kernel &kernel,
+    const float *initial_b,
+    unsigned int initial_b_count,
+    const fit_config_t &config,
+    std::vector< fit_stats_t > *stats
   ) {
-    std::array< int, max_harmony > n;
-    std::fill( n.begin(), n.end(), -1 );
-    for( int i = 0; i != max_harmony; ++i )
-      if( i % freq == 0 )
-        n[ i ] = i / freq;
-    return n;
+    return find_b_2op_chains( expected, kernel, initial_b, initial_b_count, config, stats, nullptr );
   }
   std::tuple< float, float > find_b_2op(
     const float *expected,
-    const std::vector< std::pair< float, float > > &pre,
-    unsigned int freq
+    const sideband_kernel &kernel,
+    float initial_b,
+    const fit_config_t &config,
+    std::vector< fit_stats_t > *stats
   ) {
-    float lowest_loss = std::numeric_limits< float >::max();
-    float best_b = 0;
-    std::array< int, max_harmony > n = generate_n( freq );
-    for( unsigned int try_count = 0; try_count != 5; ++try_count ) {
-      const auto [loss,b] = find_b_2op( expected, pre, freq, try_count, n );
-      if( lowest_loss > loss ) {
-        best_b = b;
-        lowest_loss = loss;
+    return find_b_2op( expected, kernel, &initial_b, 1u, config, stats );
+  }
+  std::tuple< float, float > find_b_2op(
+    const float *expected,
+    unsigned int freq,
+    const fit_config_t &config,
+    std::vector< fit_stats_t > *stats
+  ) {
+    const sideband_kernel kernel( 1u, freq, config.harmony_count );
+    return find_b_2op( expected, kernel, restart_b.data(), restart_b.size(), config, stats );
+  }
+  namespace {
+    struct basin_t {
+      float loss;
+      unsigned int kernel;
+      float b;
+    };
+    constexpr unsigned int min_freq = 1;
+    constexpr unsigned int max_freq = 20;
+    std::vector< sideband_kernel > ratio_kernels( unsigned int harmony_count ) {
+      std::vector< sideband_kernel > kernels;
+      for( unsigned int freq = min_freq; freq < max_freq; ++freq )
+        kernels.emplace_back( 1u, freq, harmony_count );
+      return kernels;
+    }
+    std::vector< unsigned int > order_by_bound( const std::vector< float > &bounds ) {
+      std::vector< unsigned int > order( bounds.size() );
+      std::iota( order.begin(), order.end(), 0u );
+      std::sort( order.begin(), order.end(), [&]( unsigned int l, unsigned int r ) { return bounds[ l ] < bounds[ r ]; } );
+      return order;
+    }
+    std::tuple< float, unsigned int, float > find_b_2op_descent(
+      const float *expected,
+      const fit_config_t &config,
+      std::vector< fit_stats_t > *stats
+    ) {
+      const auto kernels = ratio_kernels( config.harmony_count );
+      std::vector< float > bounds( kernels.size() );
+      for( unsigned int k = 0; k != kernels.size(); ++k )
+        bounds[ k ] = loss_lower_bound( expected, kernels[ k ] );
+      const auto order = order_by_bound( bounds );
+      std::vector< std::tuple< float, float > > results( kernels.size(), std::make_tuple( std::numeric_limits< float >::max(), 0.f ) );
+      std::vector< std::vector< fit_stats_t > > freq_stats( kernels.size() );
+      shared_best_t shared_best;
+#pragma omp parallel for schedule(dynamic)
+      for( unsigned int i = 0; i < order.size(); ++i ) {
+        const unsigned int k = order[ i ];
+        results[ k ] = find_b_2op_chains( expected, kernels[ k ], restart_b.data(), restart_b.size(), config, stats ? &freq_stats[ k ] : nullptr, &shared_best );
+      }
+      if( stats )
+        for( const auto &s: freq_stats )
+          stats->insert( stats->end(), s.begin(), s.end() );
+      float lowest_loss = std::numeric_limits< float >::max();
+      float best_b = 0;
+      unsigned int best_freq = 0;
+      for( unsigned int k = 0; k != kernels.size(); ++k ) {
+        if( lowest_loss > std::get< 0 >( results[ k ] ) ) {
+          best_b = std::get< 1 >( results[ k ] );
+          best_freq = kernels[ k ].get_modulator();
+          lowest_loss = std::get< 0 >( results[ k ] );
+        }
+      }
+      return std::make_tuple( lowest_loss, best_freq, best_b );
+    }
+    std::tuple< float, unsigned int, float > find_b_2op_grid(
+      const float *expected,
+      const fit_config_t &config,
+      std::vector< fit_stats_t > *stats
+    ) {
+      const unsigned int b_count = std::max( 2u, unsigned( config.grid_max_b / config.grid_step ) + 1u );
+      std::vector< float > bs( b_count );
+      for( unsigned int i = 0; i != b_count; ++i )
+        bs[ i ] = i * config.grid_step;
+      const auto kernels = ratio_kernels( config.harmony_count );
+      std::vector< float > bounds( kernels.size() );
+      for( unsigned int k = 0; k != kernels.size(); ++k )
+        bounds[ k ] = loss_lower_bound( expected, kernels[ k ] );
+      const auto order = order_by_bound( bounds );
+      shared_best_t shared_best;
+      std::vector< float > losses( kernels.size() * b_count );
+      std::vector< std::uint8_t > evaluated( kernels.size(), 0u );
+#pragma omp parallel for schedule(dynamic)
+      for( unsigned int i = 0; i < order.size(); ++i ) {
+        const unsigned int k = order[ i ];
+        if( bounds[ k ] > shared_best.get() ) continue;
+        float *loss = losses.data() + size_t( k ) * b_count;
+        lossimage( expected, kernels[ k ], bs.data(), b_count, loss );
+        shared_best.update( *std::min_element( loss, loss + b_count ) );
+        evaluated[ k ] = 1u;
+      }
+      std::vector< basin_t > basins;
+      for( unsigned int k = 0; k != kernels.size(); ++k ) {
+        if( !evaluated[ k ] ) continue;
+        const float *loss = losses.data() + size_t( k ) * b_count;
+        for( unsigned int i = 0; i != b_count; ++i ) {
+          const bool left = i == 0 || loss[ i ] < loss[ i - 1 ];
+          const bool right = i == b_count - 1 || loss[ i ] <= loss[ i + 1 ];
+          if( left && right ) basins.push_back( basin_t{ loss[ i ], k, bs[ i ] } );
+        }
+      }
+      const unsigned int basin_count = std::min< unsigned int >( std::max( config.basin_count, 1u ), basins.size() );
+      std::partial_sort( basins.begin(), std::next( basins.begin(), basin_count ), basins.end(), []( const basin_t &l, const basin_t &r ) { return l.loss < r.loss; } );
+      basins.resize( basin_count );
+      std::vector< std::vector< fit_stats_t > > basin_stats( basin_count );
+#pragma omp parallel for schedule(dynamic)
+      for( unsigned int i = 0; i < basin_count; ++i ) {
+        const auto [loss,b] = find_b_2op_chains( expected, kernels[ basins[ i ].kernel ], &basins[ i ].b, 1u, config, stats ? &basin_stats[ i ] : nullptr, &shared_best );
+        if( loss < basins[ i ].loss ) {
+          basins[ i ].loss = loss;
+          basins[ i ].b = b;
+        }
       }
+      if( stats )
+        for( const auto &s: basin_stats )
+          stats->insert( stats->end(), s.begin(), s.end() );
+      if( basins.empty() ) return std::make_tuple( std::numeric_limits< float >::max(), 0u, 0.f );
+      const auto best = std::min_element( basins.begin(), basins.end(), []( const basin_t &l, const basin_t &r ) { return l.loss < r.loss; } );
+      return std::make_tuple( best->loss, kernels[ best->kernel ].get_modulator(), best->b );
     }
-    return std::make_tuple( lowest_loss, best_b );
-    //return find_b_2op( expected, pre, freq, 5, n );
   }
   std::tuple< float, unsigned int, float > find_b_2op(
     const float *expected,
-    const std::vector< std::pair< float, float > > &pre
+    const fit_config_t &config,
+    std::vector< fit_stats_t > *stats,
+    fit_cache *cache
   ) {
-    constexpr unsigned int min_freq = 1;
-    constexpr unsigned int max_freq = 20;
-    std::vector< std::tuple< float, float > > results( max_freq );
-#pragma omp parallel for
-    for( unsigned int freq = min_freq; freq < max_freq; ++freq ) {
-      results[ freq ] = find_b_2op( expected, pre, freq );
+    if( cache ) {
+      if( const auto hit = cache->find( expected, config.harmony_count, 0u, config ) ) {
+        const sideband_kernel kernel( 1u, hit->entry.freq, config.harmony_count );
+        if( hit->exact )
+          return std::make_tuple( std::get< 0 >( lossimage( expected, kernel, hit->entry.b ) ), hit->entry.freq, hit->entry.b );
+        const auto [loss,b] = find_b_2op( expected, kernel, hit->entry.b, config, stats );
+        cache->insert( expected, config.harmony_count, 0u, config, fit_cache_entry_t{ loss, hit->entry.freq, b } );
+        return std::make_tuple( loss, hit->entry.freq, b );
+      }
     }
-    float lowest_loss = std::numeric_limits< float >::max();
-    float best_b = 0;
-    unsigned int best_freq = 0;
-    for( unsigned int freq = min_freq; freq != max_freq; ++freq ) {
-      if( lowest_loss > std::get< 0 >( results[ freq ] ) ) {
-        best_b = std::get< 1 >( results[ freq ] );
-        best_freq = freq;
-        lowest_loss = std::get< 0 >( results[ freq ] );
+    const auto result = config.search == fit_search_t::descent ?
+      find_b_2op_descent( expected, config, stats ) :
+      find_b_2op_grid( expected, config, stats );
+    if( cache ) {
+      const auto [loss,freq,b] = result;
+      cache->insert( expected, config.harmony_count, 0u, config, fit_cache_entry_t{ loss, freq, b } );
+    }
+    return result;
+  }
+  namespace {
+    float find_b_2op_coarse(
+      const float *expected,
+      const sideband_kernel &kernel,
+      const fit_config_t &config
+    ) {
+      const unsigned int b_count = std::max( 2u, unsigned( config.grid_max_b / config.grid_step ) + 1u );
+      std::vector< float > bs( b_count );
+      for( unsigned int i = 0; i != b_count; ++i )
+        bs[ i ] = i * config.grid_step;
+      std::vector< float > loss( b_count );
+      lossimage( expected, kernel, bs.data(), b_count, loss.data() );
+      return bs[ std::distance( loss.begin(), std::min_element( loss.begin(), loss.end() ) ) ];
+    }
+    struct frame_chunk_t {
+      std::vector< unsigned int > frames;
+      bool leading;
+      float seed;
+      float carry;
+    };
+  }
+  namespace {
+    std::tuple< float, float > find_b_2op_frame(
+      const float *expected,
+      const sideband_kernel &kernel,
+      float initial_b,
+      const fit_config_t &config,
+      std::vector< fit_stats_t > *stats,
+      fit_cache *cache,
+      bool &cached
+    ) {
+      cached = false;
+      if( !cache ) return find_b_2op( expected, kernel, initial_b, config, stats );
+      const unsigned int harmony_count = kernel.get_harmony_count();
+      const unsigned int freq = kernel.get_modulator();
+      const auto hit = cache->find( expected, harmony_count, freq, config );
+      if( hit && hit->exact ) {
+        cached = true;
+        return std::make_tuple( std::get< 0 >( lossimage( expected, kernel, hit->entry.b ) ), hit->entry.b );
+      }
+      const std::array< float, 2u > starts{ initial_b, hit ? hit->entry.b : initial_b };
+      const auto result = find_b_2op( expected, kernel, starts.data(), hit ? 2u : 1u, config, stats );
+      cache->insert( expected, harmony_count, freq, config, fit_cache_entry_t{ std::get< 0 >( result ), freq, std::get< 1 >( result ) } );
+      return result;
+    }
+  }
+  std::vector< std::tuple< float, float > > find_b_2op_frames(
+    const float *expected,
+    unsigned int stride,
+    unsigned int frame_count,
+    unsigned int origin,
+    float origin_b,
+    const sideband_kernel &kernel,
+    const fit_config_t &config,
+    std::vector< fit_stats_t > *stats,
+    fit_cache *cache
+  ) {
+    std::vector< std::tuple< float, float > > results( frame_count, std::make_tuple( 0.f, 0.f ) );
+    if( origin >= frame_count ) return results;
+    results[ origin ] = std::make_tuple( std::get< 0 >( lossimage( expected + origin * stride, kernel, origin_b ) ), origin_b );
+    const unsigned int chunk_size = std::max( config.chunk_size, 1u );
+    std::array< std::vector< frame_chunk_t >, 2u > paths;
+    for( unsigned int y = origin + 1; y < frame_count; ++y ) {
+      if( ( y - origin - 1 ) % chunk_size == 0 ) paths[ 0 ].push_back( frame_chunk_t{ {}, paths[ 0 ].empty(), origin_b, origin_b } );
+      paths[ 0 ].back().frames.push_back( y );
+    }
+    for( unsigned int y = origin; y > 0; --y ) {
+      if( ( origin - y ) % chunk_size == 0 ) paths[ 1 ].push_back( frame_chunk_t{ {}, paths[ 1 ].empty(), origin_b, origin_b } );
+      paths[ 1 ].back().frames.push_back( y - 1 );
+    }
+    std::vector< frame_chunk_t* > chunks;
+    for( auto &path: paths )
+      for( auto &chunk: path )
+        chunks.push_back( &chunk );
+    std::vector< float > carry_after( frame_count, origin_b );
+    std::vector< std::uint8_t > cached( frame_count, 0u );
+    std::vector< std::vector< fit_stats_t > > chunk_stats( chunks.size() );
+#pragma omp parallel for schedule(dynamic)
+    for( unsigned int c = 0; c < chunks.size(); ++c ) {
+      auto &chunk = *chunks[ c ];
+      auto *chunk_stat = stats ? &chunk_stats[ c ] : nullptr;
+      if( !chunk.leading )
+        chunk.seed = std::min( origin_b, find_b_2op_coarse( expected + chunk.frames.front() * stride, kernel, config ) );
+      float carry = chunk.seed;
+      for( const auto y: chunk.frames ) {
+        bool hit = false;
+        results[ y ] = find_b_2op_frame( expected + y * stride, kernel, carry, config, chunk_stat, cache, hit );
+        cached[ y ] = hit;
+        carry = std::min( std::get< 1 >( results[ y ] ), carry );
+        carry_after[ y ] = carry;
       }
+      chunk.carry = carry;
     }
-    return std::make_tuple( lowest_loss, best_freq, best_b );
+    std::vector< fit_stats_t > reconcile_stats;
+    for( auto &path: paths ) {
+      for( unsigned int c = 1; c < path.size(); ++c ) {
+        float carry = path[ c - 1 ].carry;
+        float parallel_carry = path[ c ].seed;
+        for( const auto y: path[ c ].frames ) {
+          if( std::abs( carry - parallel_carry ) <= config.step_tolerance ) break;
+          parallel_carry = carry_after[ y ];
+          if( !cached[ y ] ) {
+            const auto refit = find_b_2op( expected + y * stride, kernel, carry, config, stats ? &reconcile_stats : nullptr );
+            if( std::get< 0 >( refit ) < std::get< 0 >( results[ y ] ) ) {
+              results[ y ] = refit;
+              if( cache ) cache->insert( expected + y * stride, kernel.get_harmony_count(), kernel.get_modulator(), config, fit_cache_entry_t{ std::get< 0 >( refit ), kernel.get_modulator(), std::get< 1 >( refit ) } );
+            }
+          }
+          carry = std::min( std::get< 1 >( results[ y ] ), carry );
+          carry_after[ y ] = carry;
+        }
+        path[ c ].carry = carry_after[ path[ c ].frames.back() ];
+      }
+    }
+    if( stats ) {
+      for( const auto &s: chunk_stats )
+        stats->insert( stats->end(), s.begin(), s.end() );
+      stats->insert( stats->end(), reconcile_stats.begin(), reconcile_stats.end() );
+    }
+    return results;
   }
 }
-
@@ -41,7 +41,8 @@ int main( int argc, char *argv[] ) {
     ("decay,d", boost::program_options::value<bool>()->default_value( true ), "decay")
     ("alpha,a", boost::program_options::value<float>()->default_value( 1 ), "a")
     ("beta,b", boost::program_options::value<float>()->default_value( 1 ), "b")
-    ("length,l", boost::program_options::value<float>()->default_value( 1 ), "l");
+    ("length,l", boost::program_options::value<float>()->default_value( 1 ), "l")
+    ("solver,s", boost::program_options::value<std::string>()->default_value("adam"), "最適化手法 (adam|lm)");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
@@ -52,8 +53,9 @@ int main( int argc, char *argv[] ) {
   float x0, x1, x2, y0, y1, y2;
   float a = params["alpha"].as<float>();
   float b = params["beta"].as<float>();
+  const ifm::fit_solver_t solver = params[ "solver" ].as< std::string >() == "lm" ? ifm::fit_solver_t::levenberg_marquardt : ifm::fit_solver_t::adam;
   if( params["decay"].as<bool>() ) {
-    const auto [d1,d2] = ifm::approxymate_decay( a, b, params["length"].as<float>() );
+    const auto [d1,d2] = ifm::approxymate_decay( a, b, params["length"].as<float>(), solver );
     x0 = 0;
     x1 = d1;
     x2 = d2;
@@ -64,7 +66,7 @@ int main( int argc, char *argv[] ) {
   }
   else {
     x0 = 0;
-    x1 = ifm::approxymate_attack( a, b, params["length"].as<float>() );
+    x1 = ifm::approxymate_attack( a, b, params["length"].as<float>(), solver );
     x2 = params["length"].as<float>();
     y0 = ifm::get_exp_envelope( a, b, x0 );
     y1 = ifm::get_exp_envelope( a, b, x1 );
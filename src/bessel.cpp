@@ -20,9 +20,14 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <cstdint>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <limits>
 #include "ifm/bessel.h"
+#include "ifm/bessel_precomp.h"
 namespace ifm {
   float bessel_kind1_1( float b, int n ) {
     float prev = 0;
@@ -49,8 +54,73 @@ namespace ifm {
   }
 
   float bessel_kind1( float b, int n ) {
-    if( n % 2 ) return bessel_kind1_1( b, n );
-    else return bessel_kind1_0( b, n );
+    return float( bessel_kind1_reference( b, n ) );
+  }
+
+  double bessel_kind1_reference( double x_, int n_ ) {
+    using real_t = long double;
+    constexpr real_t epsilon = std::numeric_limits< real_t >::epsilon();
+    const unsigned int n = std::abs( n_ );
+    real_t sign = ( n_ < 0 && n % 2u ) ? -1 : 1;
+    if( x_ < 0 ) {
+      if( n % 2u ) sign = -sign;
+      x_ = -x_;
+    }
+    const real_t x = x_;
+    if( x == 0 ) return n ? 0.0 : double( sign );
+    if( x < 12 ) {
+      const real_t half = x / 2;
+      real_t term = 1;
+      for( unsigned int i = 1u; i <= n; ++i )
+        term *= half / real_t( i );
+      real_t sum = term;
+      for( unsigned int k = 1u; k != 1000u; ++k ) {
+        term *= -half * half / ( real_t( k ) * real_t( k + n ) );
+        sum += term;
+        if( std::abs( term ) <= epsilon * std::abs( sum ) ) break;
+      }
+      return double( sign * sum );
+    }
+    if( x >= 30 && x >= real_t( n ) * real_t( n ) / 2 ) {
+      const real_t mu = 4 * real_t( n ) * real_t( n );
+      real_t p = 1;
+      real_t q = 0;
+      real_t term = 1;
+      for( unsigned int k = 1u; k != 200u; ++k ) {
+        const real_t odd = 2 * real_t( k ) - 1;
+        const real_t next = term * ( mu - odd * odd ) / ( real_t( k ) * 8 * x );
+        if( std::abs( next ) > std::abs( term ) ) break;
+        term = next;
+        const real_t signed_term = ( ( k / 2u ) % 2u ) ? -term : term;
+        if( k % 2u ) q += signed_term;
+        else p += signed_term;
+        if( std::abs( term ) <= epsilon ) break;
+      }
+      const real_t chi = x - ( real_t( n ) / 2 + real_t( 0.25 ) ) * real_t( M_PI );
+      return double( sign * std::sqrt( 2 / ( real_t( M_PI ) * x ) ) * ( p * std::cos( chi ) - q * std::sin( chi ) ) );
+    }
+    constexpr real_t rescale_threshold = 1.0e300L;
+    const real_t top = std::max( real_t( n ), x );
+    const unsigned int start = 2u * ( ( unsigned int )( top + 4 * std::sqrt( 40 * top ) ) / 2u + 16u );
+    real_t next = 0;
+    real_t cur = 1.0e-30L;
+    real_t sum = 0;
+    real_t result = 0;
+    for( unsigned int k = start; k != 0u; --k ) {
+      const real_t prev = 2 * real_t( k ) / x * cur - next;
+      next = cur;
+      cur = prev;
+      if( std::abs( cur ) > rescale_threshold ) {
+        cur /= rescale_threshold;
+        next /= rescale_threshold;
+        sum /= rescale_threshold;
+        result /= rescale_threshold;
+      }
+      if( k - 1u == n ) result = cur;
+      if( k - 1u != 0u && ( k - 1u ) % 2u == 0u ) sum += 2 * cur;
+    }
+    sum += cur;
+    return double( sign * result / sum );
   }
 
   float bessel_kind1_approx_2013( float b, int n ) {
@@ -109,15 +179,17 @@ namespace ifm {
       * std::cos( x - 2.3561945 + ( 0.58904862 - 0.63587091 * q ) * p );
   }
 
-  float bessel_kind1_approx_2019( float x, int n );
-
   float bessel_kind1_approx_2019_( float x, int n ) {
     if( n < 0 ) return 0;
     if( n == 0 ) return bessel_kind1_approx_2019_0( x );
-    if( n == 1 ) return bessel_kind1_approx_2019_1( x );
-    //if( x < 0 ) x = -x;
-    float prev = n - 1;
-    return 2*prev/x * bessel_kind1_approx_2019( x, n - 1 ) - bessel_kind1_approx_2019( x, n - 2 );
+    float l2 = bessel_kind1_approx_2019_0( x );
+    float l1 = bessel_kind1_approx_2019_1( x );
+    for( int i = 2; i <= n; ++i ) {
+      const float y = 2.f * float( i - 1 ) / x * l1 - l2;
+      l2 = l1;
+      l1 = y;
+    }
+    return l1;
   }
 
   float bessel_kind1_approx_2019_( float x, int n, float l1, float l2 ) {
@@ -129,7 +201,6 @@ namespace ifm {
     return 2*prev/x * l1 - l2;
   }
 
-  float bessel_kind1_approx_2019( float x, int n, float l1 );
   float bessel_kind1_approx_2019( float x, int n ) {
     if( n < 0 ) return 0;
     if( n == 0 ) return bessel_kind1_approx_2019_0( x );
@@ -147,31 +218,7 @@ namespace ifm {
       float b = 4*y1/(x1*x1*x1) - dy1/(x1*x1);
       return a * x * x * x * x + b * x * x * x;*/
     }
-    float prev = n - 1;
-    float l2 = bessel_kind1_approx_2019( x, n - 2 );
-    float l1 = bessel_kind1_approx_2019( x, n - 1, l2 );
-    return 2*prev/x * l1 - l2;
-  }
-  float bessel_kind1_approx_2019( float x, int n, float l1 ) {
-    if( n < 0 ) return 0;
-    if( n == 0 ) return bessel_kind1_approx_2019_0( x );
-    if( n == 1 ) return bessel_kind1_approx_2019_1( x );
-    //if( x < 0 ) x = -x;
-    float x1 = n;
-    if( x1 > x ) {
-      float y1 = bessel_kind1_approx_2019_( x1, n );
-      float yprev = bessel_kind1_approx_2019_( x1, n - 1 );
-      float dy1 = 0.5f * ( yprev - bessel_kind1_approx_2019_( x1, n + 1, y1, yprev ) );
-      float a = dy1/x1 - y1/(x1*x1);
-      float b = 2.f * y1 / x1 - dy1;
-      return ( a * x * x * x * x + b * x * x * x ) / ( x1 * x1 );
-      /*float a = dy1/(x1*x1*x1) - 3*y1/(x1*x1*x1*x1);
-      float b = 4*y1/(x1*x1*x1) - dy1/(x1*x1);
-      return a * x * x * x * x + b * x * x * x;*/
-    }
-    float prev = n - 1;
-    float l2 = bessel_kind1_approx_2019( x, n - 2 );
-    return 2*prev/x * l1 - l2;
+    return bessel_kind1_approx_2019_( x, n );
   }
   float bessel_kind1_approx_2019( float x, int n, float l1, float l2 ) {
     if( n < 0 ) return 0;
@@ -193,7 +240,7 @@ namespace ifm {
     float prev = n - 1;
     return 2*prev/x * l1 - l2;
   }
-  float bessel_kind1_approx_2019( float x, int n, const std::vector< std::pair< float, float > > &pre ) {
+  float bessel_kind1_approx_2019( float x, int n, std::span< const std::pair< float, float > > pre ) {
     if( n < 0 ) return 0;
     if( n == 0 ) return bessel_kind1_approx_2019_0( x );
     if( n == 1 ) return bessel_kind1_approx_2019_1( x );
@@ -212,10 +259,9 @@ namespace ifm {
       }
       else return bessel_kind1_approx_2019( x, n );
     }
-    float prev = n - 1;
-    return 2*prev/x * bessel_kind1_approx_2019( x, n - 1 ) - bessel_kind1_approx_2019( x, n - 2 );
+    return bessel_kind1_approx_2019_( x, n );
   }
-  float bessel_kind1_approx_2019( float x, int n, float l1, float l2, const std::vector< std::pair< float, float > > &pre ) {
+  float bessel_kind1_approx_2019( float x, int n, float l1, float l2, std::span< const std::pair< float, float > > pre ) {
     if( n < 0 ) return 0;
     if( n == 0 ) return bessel_kind1_approx_2019_0( x );
     if( n == 1 ) return bessel_kind1_approx_2019_1( x );
@@ -237,16 +283,154 @@ namespace ifm {
     float prev = n - 1;
     return 2*prev/x * l1 - l2;
   }
-  std::vector< std::pair< float, float > > create_bessel_approx_2019_precomp_array( int max ) {
-    std::vector< std::pair< float, float > > pre;
-    for( int i = 0; i != max; ++i ) {
-      float l1 = bessel_kind1_approx_2019( i, i - 1, pre );
-      float l2 = bessel_kind1_approx_2019( i, i - 2, pre );
-      float y = bessel_kind1_approx_2019( i, i, l1, l2, pre );
-      float dy = 0.5 * ( l1 - l2 );
-      pre.emplace_back( std::make_pair( y, dy ) ); 
+  std::vector< std::pair< float, float > > create_bessel_approx_2019_precomp_array( int max, const progress_callback_t &progress ) {
+    const auto embedded = embedded_bessel_precomp();
+    if( max >= 0 && size_t( max ) <= embedded.size() ) {
+      if( progress ) progress( max, max );
+      return std::vector< std::pair< float, float > >( embedded.begin(), std::next( embedded.begin(), max ) );
+    }
+    std::vector< std::pair< float, float > > pre( max );
+    size_t done = 0u;
+#pragma omp parallel for schedule( dynamic, 16 )
+    for( int i = 0; i < max; ++i ) {
+      float y = bessel_kind1_reference( i, i );
+      float dy = 0.5 * ( bessel_kind1_reference( i, i - 1 ) - bessel_kind1_reference( i, i + 1 ) );
+      pre[ i ] = std::make_pair( y, dy );
+      if( progress ) {
+#pragma omp critical( ifm_bessel_progress )
+        progress( ++done, max );
+      }
     }
     return pre;
   }
+  void bessel_kind1_sequence( float x, unsigned int count, float *dest ) {
+    if( count == 0u ) return;
+    const bool negative = x < 0.f;
+    if( negative ) x = -x;
+    if( x == 0.f ) {
+      dest[ 0 ] = 1.f;
+      std::fill( std::next( dest, 1 ), std::next( dest, count ), 0.f );
+    }
+    else if( x >= float( count ) && x >= 64.f ) {
+      dest[ 0 ] = bessel_kind1_approx_2019_0( x );
+      if( count > 1u ) dest[ 1 ] = bessel_kind1_approx_2019_1( x );
+      for( unsigned int i = 2u; i < count; ++i )
+        dest[ i ] = 2.f * float( i - 1u ) / x * dest[ i - 1u ] - dest[ i - 2u ];
+    }
+    else {
+      constexpr double rescale_threshold = 1.0e20;
+      const double top = std::max( double( count ), double( x ) );
+      const unsigned int start = 2u * ( ( unsigned int )( top + std::sqrt( 40.0 * top ) ) / 2u + 8u );
+      const double xd = x;
+      double next = 0.0;
+      double cur = 1.0e-30;
+      double sum = 0.0;
+      for( unsigned int k = start; k != 0u; --k ) {
+        const double prev = 2.0 * double( k ) / xd * cur - next;
+        next = cur;
+        cur = prev;
+        if( std::abs( cur ) > rescale_threshold ) {
+          cur /= rescale_threshold;
+          next /= rescale_threshold;
+          sum /= rescale_threshold;
+          for( unsigned int i = k; i < count; ++i )
+            dest[ i ] = float( dest[ i ] / rescale_threshold );
+        }
+        if( k - 1u < count ) dest[ k - 1u ] = float( cur );
+        if( k - 1u != 0u && ( k - 1u ) % 2u == 0u ) sum += 2.0 * cur;
+      }
+      sum += cur;
+      for( unsigned int i = 0u; i != count; ++i )
+        dest[ i ] = float( dest[ i ] / sum );
+    }
+    if( negative )
+      for( unsigned int i = 1u; i < count; i += 2u )
+        dest[ i ] = -dest[ i ];
+  }
+  std::vector< float > bessel_kind1_sequence( float x, unsigned int count ) {
+    std::vector< float > temp( count );
+    bessel_kind1_sequence( x, count, temp.data() );
+    return temp;
+  }
+  void bessel_kind1_sequence( float x, unsigned int count, float *value, float *derivative, float *second_derivative ) {
+    if( count == 0u ) return;
+    thread_local std::vector< float > j;
+    j.resize( count + 2u );
+    bessel_kind1_sequence( x, j.size(), j.data() );
+    if( value ) std::copy( j.begin(), std::next( j.begin(), count ), value );
+    const auto at = [&]( int n ) {
+      return n >= 0 ? j[ n ] : ( n % 2 ? -j[ -n ] : j[ -n ] );
+    };
+    if( derivative )
+      for( unsigned int n = 0u; n != count; ++n )
+        derivative[ n ] = 0.5f * ( at( int( n ) - 1 ) - j[ n + 1u ] );
+    if( second_derivative )
+      for( unsigned int n = 0u; n != count; ++n )
+        second_derivative[ n ] = 0.25f * ( at( int( n ) - 2 ) - 2.f * j[ n ] + j[ n + 2u ] );
+  }
+  namespace {
+    constexpr unsigned int bessel_lanes = 16u;
+    using bessel_vector_t = float __attribute__((vector_size( bessel_lanes * sizeof( float ) )));
+    using bessel_mask_t = int32_t __attribute__((vector_size( bessel_lanes * sizeof( int32_t ) )));
+    bool any( const bessel_mask_t &v ) {
+      int32_t temp = 0;
+      for( unsigned int i = 0u; i != bessel_lanes; ++i ) temp |= v[ i ];
+      return temp;
+    }
+  }
+  void bessel_kind1_sequence( const float *x, unsigned int x_count, unsigned int count, float *dest ) {
+    if( count == 0u ) return;
+    constexpr float small_x = 1.0e-4f;
+    constexpr float rescale_threshold = 1.0e20f;
+    std::vector< bessel_vector_t > stored( count );
+    for( unsigned int head = 0u; head < x_count; head += bessel_lanes ) {
+      const unsigned int lanes = std::min( bessel_lanes, x_count - head );
+      bessel_vector_t xv;
+      float top = float( count );
+      for( unsigned int l = 0u; l != bessel_lanes; ++l ) {
+        const float v = l < lanes ? std::abs( x[ head + l ] ) : 1.f;
+        xv[ l ] = v < small_x ? 1.f : v;
+        top = std::max( top, xv[ l ] );
+      }
+      const unsigned int start = 2u * ( ( unsigned int )( top + std::sqrt( 40.f * top ) ) / 2u + 8u );
+      const bessel_vector_t two_over_x = 2.f / xv;
+      bessel_vector_t next = bessel_vector_t{} + 0.f;
+      bessel_vector_t cur = bessel_vector_t{} + 1.0e-30f;
+      bessel_vector_t sum = bessel_vector_t{} + 0.f;
+      for( unsigned int k = start; k != 0u; --k ) {
+        const bessel_vector_t prev = float( k ) * two_over_x * cur - next;
+        next = cur;
+        cur = prev;
+        const bessel_mask_t overflow = ( cur > rescale_threshold ) | ( cur < -rescale_threshold );
+        if( any( overflow ) ) {
+          const bessel_vector_t scale = overflow ? bessel_vector_t{} + 1.f / rescale_threshold : bessel_vector_t{} + 1.f;
+          cur *= scale;
+          next *= scale;
+          sum *= scale;
+          for( unsigned int i = k; i < count; ++i )
+            stored[ i ] *= scale;
+        }
+        if( k - 1u < count ) stored[ k - 1u ] = cur;
+        if( k - 1u != 0u && ( k - 1u ) % 2u == 0u ) sum += 2.f * cur;
+      }
+      sum += cur;
+      const bessel_vector_t inv_sum = 1.f / sum;
+      for( unsigned int n = 0u; n != count; ++n )
+        stored[ n ] *= inv_sum;
+      for( unsigned int l = 0u; l != lanes; ++l ) {
+        const float v = x[ head + l ];
+        float *row = std::next( dest, size_t( head + l ) * count );
+        if( std::abs( v ) < small_x ) {
+          std::fill( row, std::next( row, count ), 0.f );
+          row[ 0 ] = 1.f - v * v / 4.f;
+          if( count > 1u ) row[ 1 ] = v / 2.f;
+          if( count > 2u ) row[ 2 ] = v * v / 8.f;
+        }
+        else {
+          for( unsigned int n = 0u; n != count; ++n )
+            row[ n ] = ( v < 0.f && n % 2u ) ? -stored[ n ][ l ] : stored[ n ][ l ];
+        }
+      }
+    }
+  }
 }
-
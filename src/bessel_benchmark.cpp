@@ -20,53 +20,232 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <cmath>
+#include <array>
+#include <vector>
+#include <string>
+#include <limits>
 #include <fstream>
 #include <iostream>
 #include <chrono>
+#include <functional>
+#include <omp.h>
 #include <boost/program_options.hpp>
 #include <nlohmann/json.hpp>
 #include "ifm/bessel.h"
+#include "ifm/bessel_table.h"
+#include "ifm/bessel_precomp.h"
+
+struct domain_t {
+  std::vector< float > x;
+  unsigned int n_min;
+  unsigned int n_max;
+  unsigned int get_order_count() const { return n_max - n_min + 1u; }
+};
+
+using evaluator_t = std::function< void( const domain_t&, float* ) >;
+
+struct variant_t {
+  std::string name;
+  unsigned int max_order;
+  evaluator_t eval;
+};
+
+evaluator_t per_order( std::function< float( float, int ) > f ) {
+  return [f]( const domain_t &domain, float *dest ) {
+    for( const auto x: domain.x )
+      for( unsigned int n = domain.n_min; n <= domain.n_max; ++n )
+        *dest++ = f( x, n );
+  };
+}
+
+evaluator_t per_row( std::function< void( float, unsigned int, float* ) > f ) {
+  return [f]( const domain_t &domain, float *dest ) {
+    std::vector< float > row( domain.n_max + 1u );
+    for( const auto x: domain.x ) {
+      f( x, row.size(), row.data() );
+      dest = std::copy( std::next( row.begin(), domain.n_min ), row.end(), dest );
+    }
+  };
+}
+
+nlohmann::json measure_error( const domain_t &domain, const std::vector< double > &expected, const std::vector< float > &actual, double relative_floor ) {
+  double max_abs = 0.0;
+  double sum_abs = 0.0;
+  double max_rel = 0.0;
+  double sum_rel = 0.0;
+  size_t finite = 0u;
+  size_t relative_count = 0u;
+  float worst_x = 0.f;
+  unsigned int worst_n = 0u;
+  for( size_t i = 0u; i != actual.size(); ++i ) {
+    if( !std::isfinite( actual[ i ] ) ) continue;
+    ++finite;
+    const double error = std::abs( double( actual[ i ] ) - expected[ i ] );
+    sum_abs += error;
+    if( error > max_abs ) {
+      max_abs = error;
+      worst_x = domain.x[ i / domain.get_order_count() ];
+      worst_n = domain.n_min + i % domain.get_order_count();
+    }
+    if( std::abs( expected[ i ] ) >= relative_floor ) {
+      const double rel = error / std::abs( expected[ i ] );
+      sum_rel += rel;
+      max_rel = std::max( max_rel, rel );
+      ++relative_count;
+    }
+  }
+  nlohmann::json result;
+  result[ "max_abs" ] = max_abs;
+  result[ "mean_abs" ] = finite ? sum_abs / finite : 0.0;
+  result[ "max_rel" ] = max_rel;
+  result[ "mean_rel" ] = relative_count ? sum_rel / relative_count : 0.0;
+  result[ "worst_x" ] = worst_x;
+  result[ "worst_n" ] = worst_n;
+  result[ "non_finite" ] = actual.size() - finite;
+  return result;
+}
+
+double measure_time( const variant_t &variant, const domain_t &domain, unsigned int thread_count, double min_time ) {
+  const size_t evals = domain.x.size() * domain.get_order_count();
+  std::vector< std::vector< float > > dest( thread_count, std::vector< float >( evals ) );
+  size_t passes = 0u;
+  const auto begin = std::chrono::steady_clock::now();
+  double elapsed = 0.0;
+  while( elapsed < min_time ) {
+#pragma omp parallel for num_threads( thread_count ) schedule( static, 1 )
+    for( unsigned int t = 0u; t < thread_count; ++t )
+      variant.eval( domain, dest[ t ].data() );
+    ++passes;
+    elapsed = std::chrono::duration< double >( std::chrono::steady_clock::now() - begin ).count();
+  }
+  return double( evals ) * passes * thread_count / elapsed;
+}
+
 int main( int argc, char* argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
     ("help,h",    "ヘルプを表示")
-    ("bessel,b", boost::program_options::value<std::string>()->default_value( "bessel.mp" ), "ベッセル関数近似係数");
+    ("x-min", boost::program_options::value<float>()->default_value( 0.f ), "xの最小値")
+    ("x-max", boost::program_options::value<float>()->default_value( 40.f ), "xの最大値")
+    ("x-step", boost::program_options::value<float>()->default_value( 0.1f ), "xの間隔")
+    ("n-min", boost::program_options::value<unsigned int>()->default_value( 0u ), "最小階数")
+    ("n-max", boost::program_options::value<unsigned int>()->default_value( 59u ), "最大階数")
+    ("recursive-max", boost::program_options::value<unsigned int>()->default_value( 20u ), "再帰で計算する実装の最大階数")
+    ("threads,t", boost::program_options::value<std::vector<unsigned int>>()->multitoken(), "スレッド数(複数指定可)")
+    ("min-time", boost::program_options::value<double>()->default_value( 0.2 ), "1計測あたりの最小時間(秒)")
+    ("relative-floor", boost::program_options::value<double>()->default_value( 1.0e-3 ), "相対誤差を計算する参照値の絶対値の下限")
+    ("bessel,b", boost::program_options::value<std::string>(), "ベッセル関数近似係数(省略時は埋め込みの値)")
+    ("table", boost::program_options::value<std::string>(), "ベッセル関数の表(省略時はその場で生成)")
+    ("output,o", boost::program_options::value<std::string>(), "出力ファイル(省略時は標準出力)");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
-  if( params.count("help") ) {
+  if( params.count("help") || params[ "x-step" ].as< float >() <= 0.f || params[ "n-max" ].as< unsigned int >() < params[ "n-min" ].as< unsigned int >() ) {
     std::cout << options << std::endl;
     return 0;
   }
-  std::vector< std::pair< float, float > > pre;
-  {
-    std::ifstream bessel_file( params["bessel"].as<std::string>(), std::ofstream::binary );
-    nlohmann::json bessel = nlohmann::json::from_msgpack( bessel_file );
-    for( const auto &v: bessel )
-      pre.emplace_back( v.at( 0 ), v.at( 1 ) );
+  domain_t domain;
+  for( float x = params[ "x-min" ].as< float >(); x <= params[ "x-max" ].as< float >(); x += params[ "x-step" ].as< float >() )
+    domain.x.push_back( x );
+  domain.n_min = params[ "n-min" ].as< unsigned int >();
+  domain.n_max = params[ "n-max" ].as< unsigned int >();
+  std::vector< unsigned int > thread_counts;
+  if( params.count("threads") ) thread_counts = params[ "threads" ].as< std::vector< unsigned int > >();
+  else {
+    thread_counts.push_back( 1u );
+    if( omp_get_max_threads() > 1 ) thread_counts.push_back( omp_get_max_threads() );
   }
-  const auto t0 = std::chrono::steady_clock::now();
-  for( unsigned int b_ = 0.f; b_ != 400; ++b_ ) {
-    float b = b_ * 0.1f;
-    for( unsigned int n = 0; n != 60; ++n ) {
-      ifm::bessel_kind1( b, n );
+  const ifm::bessel_precomp pre = params.count("bessel") ? ifm::bessel_precomp( params["bessel"].as<std::string>() ) : ifm::bessel_precomp();
+  float max_abs_x = 0.f;
+  for( const auto x: domain.x ) max_abs_x = std::max( max_abs_x, std::abs( x ) );
+  const ifm::bessel_table table = params.count("table") ?
+    ifm::bessel_table( params["table"].as<std::string>() ) :
+    ifm::bessel_table( std::max( max_abs_x, 1.f ), 1.f / 64.f, domain.n_max + 1u );
+  const auto recursive_max = params[ "recursive-max" ].as< unsigned int >();
+  constexpr unsigned int unlimited = std::numeric_limits< unsigned int >::max();
+  const std::span< const std::pair< float, float > > pre_span = pre;
+  std::vector< variant_t > variants{
+    { "reference", unlimited, per_order( []( float x, int n ) { return float( ifm::bessel_kind1_reference( x, n ) ); } ) },
+    { "trapezoid", unlimited, per_order( []( float x, int n ) { return n % 2 ? ifm::bessel_kind1_1( x, n ) : ifm::bessel_kind1_0( x, n ); } ) },
+    { "approx_2013", unlimited, per_order( ifm::bessel_kind1_approx_2013 ) },
+    { "approx_2019", unlimited, per_order( []( float x, int n ) { return ifm::bessel_kind1_approx_2019( x, n ); } ) },
+    { "approx_2019_forward", unlimited, per_order( []( float x, int n ) { return ifm::bessel_kind1_approx_2019_( x, n ); } ) },
+    { "approx_2019_original1", recursive_max, per_order( ifm::bessel_kind1_approx_2019_original1 ) },
+    { "approx_2019_original2", recursive_max, per_order( ifm::bessel_kind1_approx_2019_original2 ) },
+    { "approx_2019_pre", unlimited, per_order( [pre_span]( float x, int n ) { return ifm::bessel_kind1_approx_2019( x, n, pre_span ); } ) },
+    { "approx_2019_l1l2", unlimited, per_row( []( float x, unsigned int count, float *dest ) {
+      float l1 = 0;
+      float l2 = 0;
+      for( unsigned int n = 0u; n != count; ++n ) {
+        dest[ n ] = ifm::bessel_kind1_approx_2019( x, n, l1, l2 );
+        l2 = l1;
+        l1 = dest[ n ];
+      }
+    } ) },
+    { "approx_2019_l1l2_pre", unlimited, per_row( [pre_span]( float x, unsigned int count, float *dest ) {
+      float l1 = 0;
+      float l2 = 0;
+      for( unsigned int n = 0u; n != count; ++n ) {
+        dest[ n ] = ifm::bessel_kind1_approx_2019( x, n, l1, l2, pre_span );
+        l2 = l1;
+        l1 = dest[ n ];
+      }
+    } ) },
+    { "sequence", unlimited, per_row( []( float x, unsigned int count, float *dest ) { ifm::bessel_kind1_sequence( x, count, dest ); } ) },
+    { "sequence_derivative", unlimited, per_row( []( float x, unsigned int count, float *dest ) {
+      thread_local std::vector< float > derivative;
+      derivative.resize( count );
+      ifm::bessel_kind1_sequence( x, count, dest, derivative.data() );
+    } ) },
+    { "sequence_batch", unlimited, []( const domain_t &domain, float *dest ) {
+      std::vector< float > matrix( domain.x.size() * ( domain.n_max + 1u ) );
+      ifm::bessel_kind1_sequence( domain.x.data(), domain.x.size(), domain.n_max + 1u, matrix.data() );
+      for( size_t i = 0u; i != domain.x.size(); ++i )
+        dest = std::copy( std::next( matrix.begin(), i * ( domain.n_max + 1u ) + domain.n_min ), std::next( matrix.begin(), ( i + 1u ) * ( domain.n_max + 1u ) ), dest );
+    } },
+    { "table", unlimited, per_row( [&table]( float x, unsigned int count, float *dest ) { table( x, count, dest ); } ) }
+  };
+  nlohmann::json result;
+  result[ "domain" ][ "x_min" ] = params[ "x-min" ].as< float >();
+  result[ "domain" ][ "x_max" ] = params[ "x-max" ].as< float >();
+  result[ "domain" ][ "x_step" ] = params[ "x-step" ].as< float >();
+  result[ "domain" ][ "x_count" ] = domain.x.size();
+  result[ "domain" ][ "n_min" ] = domain.n_min;
+  result[ "domain" ][ "n_max" ] = domain.n_max;
+  result[ "relative_floor" ] = params[ "relative-floor" ].as< double >();
+  result[ "variants" ] = nlohmann::json::array();
+  const auto relative_floor = params[ "relative-floor" ].as< double >();
+  const auto min_time = params[ "min-time" ].as< double >();
+  for( const auto &variant: variants ) {
+    domain_t local = domain;
+    local.n_max = std::min( domain.n_max, variant.max_order );
+    if( local.n_max < local.n_min ) continue;
+    std::vector< double > expected;
+    expected.reserve( local.x.size() * local.get_order_count() );
+    for( const auto x: local.x )
+      for( unsigned int n = local.n_min; n <= local.n_max; ++n )
+        expected.push_back( ifm::bessel_kind1_reference( x, n ) );
+    std::vector< float > actual( expected.size() );
+    variant.eval( local, actual.data() );
+    nlohmann::json entry;
+    entry[ "name" ] = variant.name;
+    entry[ "n_max" ] = local.n_max;
+    entry[ "error" ] = measure_error( local, expected, actual, relative_floor );
+    entry[ "throughput" ] = nlohmann::json::array();
+    for( const auto thread_count: thread_counts ) {
+      const double evals_per_sec = measure_time( variant, local, std::max( thread_count, 1u ), min_time );
+      nlohmann::json throughput;
+      throughput[ "threads" ] = std::max( thread_count, 1u );
+      throughput[ "evals_per_sec" ] = evals_per_sec;
+      throughput[ "ns_per_eval" ] = 1.0e9 * std::max( thread_count, 1u ) / evals_per_sec;
+      entry[ "throughput" ].push_back( throughput );
     }
+    result[ "variants" ].push_back( entry );
   }
-  const auto t1 = std::chrono::steady_clock::now();
-  for( unsigned int b_ = 0.f; b_ != 400; ++b_ ) {
-    float b = b_ * 0.1f;
-    float l1 = 0;
-    float l2 = 0;
-    for( unsigned int n = 0; n != 60; ++n ) {
-      float y = ifm::bessel_kind1_approx_2019( b, n, l1, l2, pre );
-      l2 = l1;
-      l1 = y;
-    }
+  if( params.count("output") ) {
+    std::ofstream out_file( params["output"].as<std::string>() );
+    out_file << result.dump( 2 ) << std::endl;
   }
-  const auto t2 = std::chrono::steady_clock::now();
-  float e0 = float( std::chrono::duration_cast< std::chrono::microseconds >( t1 - t0 ).count() );
-  float e1 = float( std::chrono::duration_cast< std::chrono::microseconds >( t2 - t1 ).count() );
-  std::cout << "台形公式: " << (400*60)/e0 << "Mbps(" << 400*60 << " samples in " << e0 << "microseconds)" << std::endl;
-  std::cout << "近似式: " << (400*60)/e1 << "Mbps(" << 400*60 << " samples in " << e1 << "microseconds)" << std::endl;
+  else std::cout << result.dump( 2 ) << std::endl;
 }
-
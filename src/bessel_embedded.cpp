@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <array>
+#include <utility>
+#include "ifm/bessel_precomp.h"
+
+#ifndef IFM_BESSEL_PRECOMP_MAX_ORDER
+#define IFM_BESSEL_PRECOMP_MAX_ORDER 60
+#endif
+
+namespace ifm {
+  namespace {
+    constexpr double constexpr_abs( double v ) {
+      return v < 0.0 ? -v : v;
+    }
+    constexpr unsigned int constexpr_sqrt( unsigned int v ) {
+      unsigned int r = 0u;
+      while( ( r + 1u ) * ( r + 1u ) <= v ) ++r;
+      return r;
+    }
+    constexpr std::pair< float, float > precomp_entry( unsigned int n ) {
+      if( n == 0u ) return std::make_pair( 1.f, 0.f );
+      constexpr double rescale_threshold = 1.0e250;
+      const double x = n;
+      const unsigned int top = n + 1u;
+      const unsigned int start = 2u * ( ( top + 4u * constexpr_sqrt( 40u * top ) ) / 2u + 16u );
+      double next = 0.0;
+      double cur = 1.0e-30;
+      double sum = 0.0;
+      double lower = 0.0;
+      double center = 0.0;
+      double upper = 0.0;
+      for( unsigned int k = start; k != 0u; --k ) {
+        const double prev = 2.0 * double( k ) / x * cur - next;
+        next = cur;
+        cur = prev;
+        if( constexpr_abs( cur ) > rescale_threshold ) {
+          cur /= rescale_threshold;
+          next /= rescale_threshold;
+          sum /= rescale_threshold;
+          lower /= rescale_threshold;
+          center /= rescale_threshold;
+          upper /= rescale_threshold;
+        }
+        if( k - 1u == n + 1u ) upper = cur;
+        if( k - 1u == n ) center = cur;
+        if( k - 1u == n - 1u ) lower = cur;
+        if( k - 1u != 0u && ( k - 1u ) % 2u == 0u ) sum += 2.0 * cur;
+      }
+      sum += cur;
+      return std::make_pair( float( center / sum ), float( 0.5 * ( lower - upper ) / sum ) );
+    }
+    template< unsigned int max_order >
+    constexpr std::array< std::pair< float, float >, max_order > make_precomp_table() {
+      std::array< std::pair< float, float >, max_order > temp;
+      for( unsigned int n = 0u; n != max_order; ++n )
+        temp[ n ] = precomp_entry( n );
+      return temp;
+    }
+    constexpr auto embedded_table = make_precomp_table< IFM_BESSEL_PRECOMP_MAX_ORDER >();
+  }
+  std::span< const std::pair< float, float > > embedded_bessel_precomp() {
+    return embedded_table;
+  }
+}
@@ -0,0 +1,84 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+#include <nlohmann/json.hpp>
+#include "ifm/bessel_precomp.h"
+
+namespace ifm {
+  namespace {
+    constexpr std::array< char, 8u > bessel_precomp_magic{{ 'I', 'F', 'M', 'B', 'P', 'R', 'E', 0 }};
+    constexpr uint32_t bessel_precomp_version = 1u;
+    static_assert( sizeof( std::pair< float, float > ) == sizeof( float ) * 2u );
+    static_assert( std::is_standard_layout_v< std::pair< float, float > > );
+    uint32_t checksum( const uint8_t *data, size_t size ) {
+      uint32_t hash = 2166136261u;
+      for( size_t i = 0u; i != size; ++i ) {
+        hash ^= data[ i ];
+        hash *= 16777619u;
+      }
+      return hash;
+    }
+  }
+  bessel_precomp::bessel_precomp() : values( embedded_bessel_precomp() ) {}
+  bessel_precomp::bessel_precomp( const std::string &filename ) : file( new mapped_file( filename ) ) {
+    bessel_precomp_header_t header;
+    if( file->size() >= sizeof( header ) && std::memcmp( file->data(), bessel_precomp_magic.data(), bessel_precomp_magic.size() ) == 0 ) {
+      std::memcpy( &header, file->data(), sizeof( header ) );
+      if( header.version != bessel_precomp_version ) throw invalid_bessel_precomp {};
+      if( header.precision != sizeof( float ) * 8u ) throw invalid_bessel_precomp {};
+      const size_t payload = size_t( header.max_order ) * sizeof( std::pair< float, float > );
+      if( file->size() != sizeof( header ) + payload ) throw invalid_bessel_precomp {};
+      const uint8_t *head = std::next( file->data(), sizeof( header ) );
+      if( checksum( head, payload ) != header.checksum ) throw invalid_bessel_precomp {};
+      values = std::span< const std::pair< float, float > >( reinterpret_cast< const std::pair< float, float >* >( head ), header.max_order );
+    }
+    else {
+      nlohmann::json bessel = nlohmann::json::from_msgpack( file->data(), std::next( file->data(), file->size() ) );
+      auto temp = std::make_shared< std::vector< std::pair< float, float > > >();
+      for( const auto &v: bessel )
+        temp->emplace_back( v.at( 0 ), v.at( 1 ) );
+      file.reset();
+      storage = temp;
+      values = *storage;
+    }
+  }
+  void save_bessel_precomp( const std::string &filename, std::span< const std::pair< float, float > > values ) {
+    bessel_precomp_header_t header;
+    header.magic = bessel_precomp_magic;
+    header.version = bessel_precomp_version;
+    header.max_order = values.size();
+    header.precision = sizeof( float ) * 8u;
+    header.checksum = checksum( reinterpret_cast< const uint8_t* >( values.data() ), values.size_bytes() );
+    std::ofstream out_file( filename, std::ofstream::binary );
+    out_file.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+    out_file.write( reinterpret_cast< const char* >( values.data() ), values.size_bytes() );
+    if( !out_file ) {
+      std::cerr << "Unable to write " << filename << std::endl;
+      throw -1;
+    }
+  }
+}
@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+#include "ifm/bessel.h"
+#include "ifm/bessel_table.h"
+
+namespace ifm {
+  namespace {
+    constexpr std::array< char, 8u > bessel_table_magic{{ 'I', 'F', 'M', 'B', 'T', 'A', 'B', 0 }};
+    constexpr uint32_t bessel_table_version = 1u;
+  }
+  bessel_table::bessel_table( float max_x, float step_, unsigned int order_count_, const progress_callback_t &progress ) :
+    values( nullptr ), order_count( order_count_ ), point_count( 0u ), step( step_ ) {
+    if( !( step > 0.f ) || !( max_x > 0.f ) || order_count == 0u ) throw invalid_bessel_table {};
+    point_count = ( unsigned int )( std::ceil( max_x / step ) ) + 1u;
+    std::vector< float > xs( point_count );
+    for( unsigned int i = 0u; i != point_count; ++i )
+      xs[ i ] = float( i ) * step;
+    const unsigned int count = order_count + 1u;
+    constexpr unsigned int chunk_size = 256u;
+    const unsigned int chunk_count = ( point_count + chunk_size - 1u ) / chunk_size;
+    auto temp = std::make_shared< std::vector< float > >( size_t( point_count ) * order_count * 2u );
+    size_t done = 0u;
+#pragma omp parallel
+    {
+      std::vector< float > sequence( size_t( chunk_size ) * count );
+#pragma omp for schedule( dynamic, 1 )
+      for( unsigned int chunk = 0u; chunk < chunk_count; ++chunk ) {
+        const unsigned int head = chunk * chunk_size;
+        const unsigned int length = std::min( chunk_size, point_count - head );
+        bessel_kind1_sequence( std::next( xs.data(), head ), length, count, sequence.data() );
+        for( unsigned int i = 0u; i != length; ++i ) {
+          const float *j = std::next( sequence.data(), size_t( i ) * count );
+          float *dest = std::next( temp->data(), size_t( head + i ) * order_count * 2u );
+          dest[ 0 ] = j[ 0 ];
+          dest[ 1 ] = -j[ 1 ];
+          for( unsigned int n = 1u; n != order_count; ++n ) {
+            dest[ n * 2u ] = j[ n ];
+            dest[ n * 2u + 1u ] = 0.5f * ( j[ n - 1u ] - j[ n + 1u ] );
+          }
+        }
+        if( progress ) {
+#pragma omp critical( ifm_bessel_progress )
+          {
+            done += length;
+            progress( done, point_count );
+          }
+        }
+      }
+    }
+    storage = temp;
+    values = storage->data();
+  }
+  bessel_table::bessel_table( const std::string &filename ) :
+    file( new mapped_file( filename ) ), values( nullptr ), order_count( 0u ), point_count( 0u ), step( 0.f ) {
+    validate( file->size() );
+    values = reinterpret_cast< const float* >( std::next( file->data(), sizeof( bessel_table_header_t ) ) );
+  }
+  void bessel_table::validate( size_t size ) {
+    bessel_table_header_t header;
+    if( size < sizeof( header ) ) throw invalid_bessel_table {};
+    std::memcpy( &header, file->data(), sizeof( header ) );
+    if( header.magic != bessel_table_magic ) throw invalid_bessel_table {};
+    if( header.version != bessel_table_version ) throw invalid_bessel_table {};
+    if( header.order_count == 0u || header.point_count < 2u || !( header.step > 0.f ) ) throw invalid_bessel_table {};
+    if( size != sizeof( header ) + size_t( header.point_count ) * header.order_count * 2u * sizeof( float ) ) throw invalid_bessel_table {};
+    order_count = header.order_count;
+    point_count = header.point_count;
+    step = header.step;
+  }
+  void bessel_table::save( const std::string &filename ) const {
+    bessel_table_header_t header;
+    header.magic = bessel_table_magic;
+    header.version = bessel_table_version;
+    header.order_count = order_count;
+    header.point_count = point_count;
+    header.step = step;
+    std::ofstream out_file( filename, std::ofstream::binary );
+    out_file.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+    out_file.write( reinterpret_cast< const char* >( values ), size_t( point_count ) * order_count * 2u * sizeof( float ) );
+    if( !out_file ) {
+      std::cerr << "Unable to write " << filename << std::endl;
+      throw -1;
+    }
+  }
+  std::tuple< float, float > bessel_table::value_and_derivative( float x, unsigned int n ) const {
+    const float ax = std::abs( x );
+    const float value_sign = ( x < 0.f && n % 2u ) ? -1.f : 1.f;
+    const float derivative_sign = ( x < 0.f && !( n % 2u ) ) ? -1.f : 1.f;
+    if( n >= order_count || ax > get_max_x() ) {
+      std::vector< float > j( n + 2u );
+      bessel_kind1_sequence( ax, j.size(), j.data() );
+      const float dy = n ? 0.5f * ( j[ n - 1u ] - j[ n + 1u ] ) : -j[ 1 ];
+      return std::make_tuple( value_sign * j[ n ], derivative_sign * dy );
+    }
+    const float pos = ax / step;
+    const unsigned int i = std::min( ( unsigned int )( pos ), point_count - 2u );
+    const float t = pos - float( i );
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    const float *p0 = std::next( values, ( size_t( i ) * order_count + n ) * 2u );
+    const float *p1 = std::next( p0, size_t( order_count ) * 2u );
+    const float y =
+      ( 2.f * t3 - 3.f * t2 + 1.f ) * p0[ 0 ] + ( t3 - 2.f * t2 + t ) * step * p0[ 1 ] +
+      ( -2.f * t3 + 3.f * t2 ) * p1[ 0 ] + ( t3 - t2 ) * step * p1[ 1 ];
+    const float dy =
+      ( 6.f * t2 - 6.f * t ) * ( p0[ 0 ] - p1[ 0 ] ) / step +
+      ( 3.f * t2 - 4.f * t + 1.f ) * p0[ 1 ] + ( 3.f * t2 - 2.f * t ) * p1[ 1 ];
+    return std::make_tuple( value_sign * y, derivative_sign * dy );
+  }
+  float bessel_table::operator()( float x, unsigned int n ) const {
+    return std::get< 0 >( value_and_derivative( x, n ) );
+  }
+  void bessel_table::operator()( float x, unsigned int count, float *dest ) const {
+    const float ax = std::abs( x );
+    if( count > order_count || ax > get_max_x() ) {
+      bessel_kind1_sequence( x, count, dest );
+      return;
+    }
+    const float pos = ax / step;
+    const unsigned int i = std::min( ( unsigned int )( pos ), point_count - 2u );
+    const float t = pos - float( i );
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    const float h00 = 2.f * t3 - 3.f * t2 + 1.f;
+    const float h10 = ( t3 - 2.f * t2 + t ) * step;
+    const float h01 = -2.f * t3 + 3.f * t2;
+    const float h11 = ( t3 - t2 ) * step;
+    const float *p0 = std::next( values, size_t( i ) * order_count * 2u );
+    const float *p1 = std::next( p0, size_t( order_count ) * 2u );
+    for( unsigned int n = 0u; n != count; ++n )
+      dest[ n ] = h00 * p0[ n * 2u ] + h10 * p0[ n * 2u + 1u ] + h01 * p1[ n * 2u ] + h11 * p1[ n * 2u + 1u ];
+    if( x < 0.f )
+      for( unsigned int n = 1u; n < count; n += 2u )
+        dest[ n ] = -dest[ n ];
+  }
+}
@@ -27,37 +27,51 @@ SOFTWARE.
 #include <omp.h>
 #include "ifm/exp_match.h"
 #include "ifm/adam.h"
+#include "ifm/levenberg_marquardt.h"
 namespace ifm {
   std::tuple< float, float >
-  exp_match( const float *expected, unsigned int size, float dt, float c ) {
+  exp_match( const float *expected, unsigned int size, float dt, float c, fit_solver_t solver ) {
+    if( solver == fit_solver_t::levenberg_marquardt ) {
+      levenberg_marquardt_config_t< double, 2u > config;
+      config.lower[ 0 ] = 0.0;
+      const auto result = levenberg_marquardt(
+        [&]( const std::array< double, 2u > &p, normal_equation_t< double, 2u > &eq ) {
+          const auto a = dual< double, 2u >::variable( p[ 0 ], 0u );
+          const auto b = dual< double, 2u >::variable( p[ 1 ], 1u );
+          for( unsigned int i = 0; i < size; ++i ) {
+            const auto r = exp_envelope( a, b, dt * float( i ) ) - expected[ i ]/c;
+            eq( r.value, r.gradient );
+          }
+        },
+        std::array< double, 2u >{ 1.0, 0.0 },
+        config
+      );
+      return std::make_tuple( float( result.x[ 0 ] ), float( result.x[ 1 ] ) );
+    }
     float a = 1.0;
     float b = 0.0;
     adam< float > aopt( 0.001, 0.9, 0.999 );
     adam< float > bopt( 0.001, 0.9, 0.999 );
     for( unsigned int cycle = 0; cycle != 50000; ++cycle ) {
-      std::vector< float > ag( size );
-      std::vector< float > bg( size );
+      const auto ad = dual< float, 2u >::variable( a, 0u );
+      const auto bd = dual< float, 2u >::variable( b, 1u );
+      std::vector< dual< float, 2u > > loss( size );
 #pragma omp parallel for
       for( unsigned int i = 0; i < size; ++i ) {
-        float x = dt * float( i );
-        float generated = ( std::exp( -x * a ) * ( 1.f -  b ) + b );
-        float d = expected[ i ]/c - generated;
-        d = d * d;
-        ag[ i ] = (2*(1 - b)*(-b - (1 - b)/std::exp(a*x) + expected[ i ]/c)*x)/std::exp(a*x) * d;
-        bg[ i ] = 2*(-1 + std::exp(-(a*x)))*(-b - (1 - b)/std::exp(a*x) + expected[ i ]/c) * d;
+        const auto d = expected[ i ]/c - exp_envelope( ad, bd, dt * float( i ) );
+        loss[ i ] = d * d;
       }
-      float grad_a = std::accumulate( ag.begin(), ag.end(), float( 0 ) );
-      float grad_b = std::accumulate( bg.begin(), bg.end(), float( 0 ) );
-      a -= aopt( grad_a );
-      b -= bopt( grad_b );
+      const auto total = std::accumulate( loss.begin(), loss.end(), dual< float, 2u >() );
+      a -= aopt( total.gradient[ 0 ] );
+      b -= bopt( total.gradient[ 1 ] );
     }
     return std::make_tuple( a, b );
   }
   exp_envelope_params_t
-  get_attack_and_decay_exp( const float *expected, unsigned int size, float dt, bool damped ) {
+  get_attack_and_decay_exp( const float *expected, unsigned int size, float dt, bool damped, fit_solver_t solver ) {
     const auto highest = std::max_element( expected, std::next( expected, size ) );
     const auto highest_pos = std::distance( expected, highest );
-    const auto [decay_a, decay_b] = exp_match( std::next( expected, highest_pos ), size - highest_pos, dt, *highest );
+    const auto [decay_a, decay_b] = exp_match( std::next( expected, highest_pos ), size - highest_pos, dt, *highest, solver );
     std::vector< float > reversed( std::make_reverse_iterator( highest ), std::make_reverse_iterator( expected ) );
     if( damped ) {
       return exp_envelope_params_t()
@@ -67,7 +81,7 @@ namespace ifm {
         .set_highest_level( *highest );
     }
     else {
-      const auto [attack_a, attack_b] = exp_match( reversed.data(), highest_pos, dt, *highest );
+      const auto [attack_a, attack_b] = exp_match( reversed.data(), highest_pos, dt, *highest, solver );
       return exp_envelope_params_t()
         .set_attack_a( attack_a )
         .set_attack_b( attack_b )
@@ -78,59 +92,82 @@ namespace ifm {
     }
   }
   float get_exp_envelope( float a, float b, float x ) {
-    return std::exp( -a*x )*(1.f-b)+b;
+    return exp_envelope( a, b, x );
   }
   std::pair< float, float > get_linear_interpolation( float x0, float y0, float x1, float y1 ) {
     float tangent = ( y0 - y1 )/( x0 - x1 );
     float shift = y0 - tangent * x0;
     return std::make_pair( tangent, shift );
   }
-  float get_envelope_error(
-    double a, double b, double m, double n
-  ) {
-    return ((-1+b)*(std::exp(a*m)*(-2+a*(m-n))+std::exp(a*n)*(2+a*(m-n))))/(2.*a*std::exp(a*(m+n)));
-  }
-  float get_sustain_error(
-    double a, double b, double m, double n
-  ) {
-    return ((-1+b)*(-std::exp(a*m)+std::exp(a*n)*(1+a*(m-n))))/(a*std::exp(a*(m+n)));
+  namespace {
+    dual< double, 2u > decay_error( double a, double b, double length, double m, double n ) {
+      using value_t = dual< double, 2u >;
+      const auto md = value_t::variable( m, 0u );
+      const auto nd = value_t::variable( n, 1u );
+      return get_envelope_error( a, b, value_t( 0.0 ), md ) + get_envelope_error( a, b, md, nd ) + get_sustain_error( a, b, nd, value_t( length ) );
+    }
+    dual< double, 1u > attack_error( double a, double b, double length, double n ) {
+      using value_t = dual< double, 1u >;
+      const auto nd = value_t::variable( n, 0u );
+      return get_envelope_error( a, b, value_t( 0.0 ), nd ) + get_envelope_error( a, b, nd, value_t( length ) );
+    }
   }
   std::tuple< float, float >
-  approxymate_decay( double a, double b, double length ) {
+  approxymate_decay( double a, double b, double length, fit_solver_t solver ) {
     double m = 1.f/3.f * length;
     double n = 2.f/3.f * length;
+    if( solver == fit_solver_t::levenberg_marquardt ) {
+      levenberg_marquardt_config_t< double, 2u > config;
+      config.lower = { 0.0, 0.0 };
+      config.upper = { length, length };
+      const auto result = levenberg_marquardt(
+        [&]( const std::array< double, 2u > &p, normal_equation_t< double, 2u > &eq ) {
+          const auto loss = decay_error( a, b, length, p[ 0 ], p[ 1 ] );
+          eq( loss.value, loss.gradient );
+        },
+        std::array< double, 2u >{ m, n },
+        config
+      );
+      return std::make_tuple( result.x[ 0 ], result.x[ 1 ] );
+    }
     adam< double > mopt( 0.001, 0.9, 0.999 );
     adam< double > nopt( 0.001, 0.9, 0.999 );
     for( unsigned int cycle = 0; cycle != 50000; ++cycle ) {
-      double r1 = get_envelope_error( a, b, 0, m );
-      double r2 = get_envelope_error( a, b, m, n );
-      double r3 = get_sustain_error( a, b, n, length );
-      double loss = r1 + r2 + r3;
-      double grad_m = ( (1.f - b + ((-1.f + b)*(std::exp(a*m) + a*std::exp(a*n)*n))/std::exp(a*(m + n)))/2.f ) * loss;
-      double grad_n = ( -((-1.f + b)*(std::exp(a*n) + std::exp(a*m)*(-1.f + a*(-2.f*length + m + n))))/(2.f*std::exp(a*(m + n))) ) * loss;
-      m -= mopt( grad_m );
-      n -= mopt( grad_n );
+      const auto loss = decay_error( a, b, length, m, n );
+      m -= mopt( loss.gradient[ 0 ] * loss.value );
+      n -= nopt( loss.gradient[ 1 ] * loss.value );
     }
     return std::make_tuple( m, n );
   }
   float
-  approxymate_attack( double a, double b, double length ) {
+  approxymate_attack( double a, double b, double length, fit_solver_t solver ) {
     double n = 2.f/3.f * length;
+    if( solver == fit_solver_t::levenberg_marquardt ) {
+      levenberg_marquardt_config_t< double, 1u > config;
+      config.lower = { 0.0 };
+      config.upper = { length };
+      const auto result = levenberg_marquardt(
+        [&]( const std::array< double, 1u > &p, normal_equation_t< double, 1u > &eq ) {
+          const auto loss = attack_error( a, b, length, p[ 0 ] );
+          eq( loss.value, loss.gradient );
+        },
+        std::array< double, 1u >{ n },
+        config
+      );
+      return result.x[ 0 ];
+    }
     adam< double > nopt( 0.001, 0.9, 0.999 );
     for( unsigned int cycle = 0; cycle != 50000; ++cycle ) {
-      double r1 = get_envelope_error( a, b, 0, n );
-      double r2 = get_envelope_error( a, b, n, length );
-      double loss = r1 + r2;
-      double grad_n = ( (1.f - b + ((-1.f + b)*(std::exp(a*n) + a*std::exp(a*length)*length))/std::exp(a*(length + n)))/2.f ) * loss;
-      n -= nopt( grad_n );
+      const auto loss = attack_error( a, b, length, n );
+      n -= nopt( loss.gradient[ 0 ] * loss.value );
     }
     return n;
   }
   std::pair< envelope_param_keyframe_t< double >, float >
-  get_attack_and_decay( const float *expected, unsigned int size, float dt, bool no_attack, bool no_sustain ) {
-    const auto e = get_attack_and_decay_exp( expected, size, dt, no_sustain );
+  get_attack_and_decay( const float *expected, unsigned int size, float dt, bool no_attack, bool no_sustain, fit_solver_t solver ) {
+    const auto e = get_attack_and_decay_exp( expected, size, dt, no_sustain, solver );
     if( no_attack && no_sustain ) {
-      const float decay_mid = approxymate_attack( e.decay_a, e.decay_b, size * dt - e.highest );
+      const float decay_mid = approxymate_attack( e.decay_a, e.decay_b, size * dt - e.highest, solver );
       if( !std::isnan( decay_mid ) ) {
         return std::make_pair(
           envelope_param_keyframe_t< double >()
@@ -151,7 +188,7 @@ namespace ifm {
       }
     }
     else if( no_attack && !no_sustain ) {
-      const auto [decay_mid,decay_end] = approxymate_decay( e.decay_a, e.decay_b, size * dt - e.highest );
+      const auto [decay_mid,decay_end] = approxymate_decay( e.decay_a, e.decay_b, size * dt - e.highest, solver );
       if( !std::isnan( decay_mid ) && !std::isnan( decay_end ) ) {
         return std::make_pair(
           envelope_param_keyframe_t< double >()
@@ -172,9 +209,9 @@ namespace ifm {
       }
     }
     else if( !no_attack && no_sustain ) {
-      const float decay_mid = approxymate_attack( e.decay_a, e.decay_b, size * dt - e.highest );
+      const float decay_mid = approxymate_attack( e.decay_a, e.decay_b, size * dt - e.highest, solver );
       if( !std::isnan( decay_mid ) ) {
-        const float attack_mid = approxymate_attack( e.attack_a, e.attack_b, e.highest );
+        const float attack_mid = approxymate_attack( e.attack_a, e.attack_b, e.highest, solver );
         return std::make_pair(
           envelope_param_keyframe_t< double >()
             .set_attack1_length( e.highest - attack_mid )
@@ -188,7 +225,7 @@ namespace ifm {
         );
       }
       else {
-        const float attack_mid = approxymate_attack( e.attack_a, e.attack_b, e.highest );
+        const float attack_mid = approxymate_attack( e.attack_a, e.attack_b, e.highest, solver );
         return std::make_pair(
           envelope_param_keyframe_t< double >()
             .set_attack1_length( e.highest - attack_mid )
@@ -201,9 +238,9 @@ namespace ifm {
       }
     }
     else {
-      const auto [decay_mid,decay_end] = approxymate_decay( e.decay_a, e.decay_b, size * dt - e.highest );
+      const auto [decay_mid,decay_end] = approxymate_decay( e.decay_a, e.decay_b, size * dt - e.highest, solver );
       if( !std::isnan( decay_mid ) && !std::isnan( decay_end ) ) {
-        const float attack_mid = approxymate_attack( e.attack_a, e.attack_b, e.highest );
+        const float attack_mid = approxymate_attack( e.attack_a, e.attack_b, e.highest, solver );
         return std::make_pair(
           envelope_param_keyframe_t< double >()
             .set_attack1_length( e.highest - attack_mid )
@@ -217,7 +254,7 @@ namespace ifm {
         );
       }
       else {
-        const float attack_mid = approxymate_attack( e.attack_a, e.attack_b, e.highest );
+        const float attack_mid = approxymate_attack( e.attack_a, e.attack_b, e.highest, solver );
         return std::make_pair(
           envelope_param_keyframe_t< double >()
             .set_attack1_length( e.highest - attack_mid )
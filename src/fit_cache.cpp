@@ -0,0 +1,148 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include "ifm/fit_cache.h"
+
+namespace ifm {
+  namespace {
+    constexpr uint32_t fit_cache_version = 1u;
+    template< typename T >
+    void fnv1a( uint64_t &hash, const T &value ) {
+      std::array< uint8_t, sizeof( T ) > bytes;
+      std::memcpy( bytes.data(), &value, sizeof( T ) );
+      for( const auto b: bytes ) {
+        hash ^= b;
+        hash *= 1099511628211ull;
+      }
+    }
+  }
+  fit_cache::fit_cache( const fit_cache_config_t &config_ ) : config( config_ ), exact( 0u ), nearest( 0u ), miss( 0u ) {}
+  fit_cache::fit_cache( const std::string &filename, const fit_cache_config_t &config_ ) : fit_cache( config_ ) {
+    std::ifstream in_file( filename, std::ifstream::binary );
+    if( !in_file ) return;
+    try {
+      const nlohmann::json cache = nlohmann::json::from_msgpack( in_file );
+      if( cache.at( "version" ).get< uint32_t >() != fit_cache_version ) throw invalid_fit_cache {};
+      for( const auto &e: cache.at( "entries" ) ) {
+        entries.emplace(
+          key_t{ e.at( 0 ).get< uint64_t >(), e.at( 1 ).get< uint32_t >(), e.at( 2 ).get< std::vector< uint16_t > >() },
+          fit_cache_entry_t{ e.at( 3 ).get< float >(), e.at( 4 ).get< unsigned int >(), e.at( 5 ).get< float >() }
+        );
+      }
+    }
+    catch( const nlohmann::json::exception& ) {
+      throw invalid_fit_cache {};
+    }
+  }
+  size_t fit_cache::key_hash_t::operator()( const key_t &key ) const {
+    uint64_t hash = key.fingerprint;
+    fnv1a( hash, key.context );
+    for( const auto v: key.spectrum ) fnv1a( hash, v );
+    return size_t( hash );
+  }
+  fit_cache::key_t fit_cache::make_key( const float *expected, unsigned int harmony_count, unsigned int context, const fit_config_t &fit_config ) const {
+    uint64_t fingerprint = 14695981039346656037ull;
+    fnv1a( fingerprint, config.resolution );
+    fnv1a( fingerprint, fit_config.max_iteration );
+    fnv1a( fingerprint, fit_config.patience );
+    fnv1a( fingerprint, fit_config.loss_tolerance );
+    fnv1a( fingerprint, fit_config.gradient_tolerance );
+    fnv1a( fingerprint, fit_config.step_tolerance );
+    fnv1a( fingerprint, fit_config.learning_rate );
+    fnv1a( fingerprint, fit_config.search );
+    fnv1a( fingerprint, fit_config.grid_max_b );
+    fnv1a( fingerprint, fit_config.grid_step );
+    fnv1a( fingerprint, fit_config.basin_count );
+    fnv1a( fingerprint, fit_config.solver );
+    float sum = 0.f;
+    for( unsigned int h = 0; h != harmony_count; ++h ) sum += std::abs( expected[ h ] );
+    key_t key{ fingerprint, context, std::vector< uint16_t >( harmony_count, 0u ) };
+    if( sum == 0.f ) return key;
+    const float scale = 1.f / ( sum * config.resolution );
+    for( unsigned int h = 0; h != harmony_count; ++h )
+      key.spectrum[ h ] = uint16_t( std::min( std::round( std::abs( expected[ h ] ) * scale ), float( std::numeric_limits< uint16_t >::max() ) ) );
+    return key;
+  }
+  std::optional< fit_cache_hit_t > fit_cache::find( const float *expected, unsigned int harmony_count, unsigned int context, const fit_config_t &fit_config ) const {
+    const auto key = make_key( expected, harmony_count, context, fit_config );
+    const long limit = long( std::floor( config.warm_distance / config.resolution ) );
+    std::shared_lock< std::shared_mutex > lock( guard );
+    const auto found = entries.find( key );
+    if( found != entries.end() ) {
+      ++exact;
+      return fit_cache_hit_t{ found->second, true };
+    }
+    std::optional< fit_cache_hit_t > best;
+    long best_distance = limit + 1;
+    for( const auto &[k,v]: entries ) {
+      if( k.fingerprint != key.fingerprint || k.context != key.context || k.spectrum.size() != key.spectrum.size() ) continue;
+      long distance = 0;
+      for( unsigned int h = 0; h != harmony_count && distance < best_distance; ++h )
+        distance += std::abs( long( k.spectrum[ h ] ) - long( key.spectrum[ h ] ) );
+      if( distance < best_distance ) {
+        best_distance = distance;
+        best = fit_cache_hit_t{ v, false };
+      }
+    }
+    if( best ) ++nearest;
+    else ++miss;
+    return best;
+  }
+  void fit_cache::insert( const float *expected, unsigned int harmony_count, unsigned int context, const fit_config_t &fit_config, const fit_cache_entry_t &entry ) {
+    auto key = make_key( expected, harmony_count, context, fit_config );
+    std::unique_lock< std::shared_mutex > lock( guard );
+    const auto [existing,inserted] = entries.emplace( std::move( key ), entry );
+    if( !inserted && entry.loss < existing->second.loss ) existing->second = entry;
+  }
+  void fit_cache::save( const std::string &filename ) const {
+    nlohmann::json cache;
+    cache[ "version" ] = fit_cache_version;
+    auto &list = cache[ "entries" ] = nlohmann::json::array();
+    {
+      std::shared_lock< std::shared_mutex > lock( guard );
+      for( const auto &[k,v]: entries )
+        list.push_back( nlohmann::json::array( { k.fingerprint, k.context, k.spectrum, v.loss, v.freq, v.b } ) );
+    }
+    const auto mp = nlohmann::json::to_msgpack( cache );
+    std::ofstream out_file( filename, std::ofstream::binary );
+    out_file.write( reinterpret_cast< const char* >( mp.data() ), mp.size() );
+    if( !out_file ) {
+      std::cerr << "Unable to write " << filename << std::endl;
+      throw -1;
+    }
+  }
+  size_t fit_cache::size() const {
+    std::shared_lock< std::shared_mutex > lock( guard );
+    return entries.size();
+  }
+  fit_cache_stats_t fit_cache::get_stats() const {
+    return fit_cache_stats_t{ exact.load(), nearest.load(), miss.load() };
+  }
+}
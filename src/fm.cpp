@@ -36,6 +36,14 @@ namespace ifm {
     return n;
   }
 
+  uint8_t parse_program_number( const std::string &v ) {
+    unsigned int n;
+    auto [ptr, ec] = std::from_chars( v.data(), v.data() + v.size(), n );
+    if( !( ptr == v.data() + v.size() && ec == std::errc{} ) ) throw invalid_configuration();
+    if( n >= 128u ) throw invalid_configuration();
+    return n;
+  }
+
   envelope_param_keyframe_t< double > load_envelope_param_keyframe( const nlohmann::json &v ) {
     auto delay = ( v.find( "delay" ) != v.end() ) ? double( v[ "delay" ] ) : 0.0;
     auto attack1 = ( v.find( "attack1" ) != v.end() ) ? double( v[ "attack1" ] ) : 0.0;
@@ -24,12 +24,14 @@ SOFTWARE.
 #include <cstdint>
 #include <cmath>
 #include <array>
+#include <vector>
 #include <iostream>
 #include <algorithm>
 #include <iterator>
 #include <nlohmann/json.hpp>
 #include <boost/program_options.hpp>
-#include "ifm/bessel.h"
+#include "ifm/sideband.h"
+#include "ifm/2op.h"
 
 int main( int argc, char *argv[] ) {
   boost::program_options::options_description options("オプション");
@@ -38,7 +40,8 @@ int main( int argc, char *argv[] ) {
     ("input,i", boost::program_options::value<std::string>(), "入力ファイル")
     ("freq,f", boost::program_options::value<int>()->default_value(1), "倍率")
     ("volume,v", boost::program_options::value<float>()->default_value(1), "出力")
-    ("level,l", boost::program_options::value<float>()->default_value(1), "変調度");
+    ("level,l", boost::program_options::value<float>()->default_value(1), "変調度")
+    ("harmony-count", boost::program_options::value<unsigned int>()->default_value(ifm::default_harmony_count), "倍音の数");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
@@ -46,48 +49,24 @@ int main( int argc, char *argv[] ) {
     std::cout << options << std::endl;
     return 0;
   }
-  constexpr int max_harmony = 50;
-  std::array< float, max_harmony > expected{ 0 };
+  const unsigned int harmony_count = params[ "harmony-count" ].as< unsigned int >();
+  std::vector< float > expected( harmony_count, 0.f );
   if( params.count("input") ) {
     std::ifstream in_file( params["input"].as<std::string>(),std::ofstream::binary );
     nlohmann::json input = nlohmann::json::from_msgpack( in_file );
     for( const auto &v: input ) {
       int key = int( v.at( 0 ) );
-      if( key < max_harmony )
+      if( key >= 1 && unsigned( key ) <= harmony_count )
         expected[ key - 1 ] = float( v.at( 1 ) );
     }
   }
-  std::array< float, max_harmony > bessel{ 0 };
-  std::array< float, max_harmony > generated{ 0 };
-  std::array< int, max_harmony > n;
-  std::fill( n.begin(), n.end(), -1 );
-  for( int i = 0; i != max_harmony; ++i )
-    if( i % params[ "freq" ].as< int >() == 0 )
-      n[ i ] = i / params[ "freq" ].as< int >();
-  const auto pre = ifm::create_bessel_approx_2019_precomp_array( max_harmony / params[ "freq" ].as< int >() + 5 );
-  float l1 = 0;
-  float l2 = 0;
-  for( unsigned int i = 0; i != max_harmony; ++i ) {
-    bessel[ i ] = ifm::bessel_kind1_approx_2019( params[ "level" ].as< float >(), i, l1, l2, pre );
-    l2 = l1;
-    l1 = bessel[ i ];
-  }
-  float bscale = 0;
-  for( unsigned int i = 0; i != max_harmony; ++i ) {
-    bscale += std::abs( bessel[ i ] );
-    if( i < max_harmony - 2 ) bscale += std::abs( bessel[ i + 2 ] );
-  }
+  std::vector< float > generated( harmony_count, 0.f );
+  const ifm::sideband_kernel kernel( 1, params[ "freq" ].as< int >(), harmony_count );
+  kernel( params[ "level" ].as< float >(), generated.data() );
   float a = params[ "volume" ].as< float >();
-  for( unsigned int i = 0; i != max_harmony - 2; ++i ) {
-    if( n[ i ] != -1 )
-      generated[ i ] = a * bessel[ n[ i ] ]/bscale;
-    else
-      generated[ i ] = 0;
-    if( i < max_harmony - 2 && n[ i + 2 ] != -1 )
-      generated[ i ] -= a * bessel[ n[ i + 2 ] ]/bscale;
-  }
+  for( auto &v: generated ) v *= a;
   float sum = 0;
-  for( unsigned int i = 0; i != max_harmony; ++i ) {
+  for( unsigned int i = 0; i != harmony_count; ++i ) {
     if( params.count("input") ) {
       if( expected[ i ] != 0 )
         std::cout << expected[ i ] << "  " << std::abs( generated[ i ] ) << " " << std::abs( generated[ i ] ) - expected[ i ] << " " << ( std::abs( generated[ i ] ) - expected[ i ] )/expected[ i ] << std::endl;
@@ -98,7 +77,6 @@ int main( int argc, char *argv[] ) {
       std::cout << std::abs( generated[ i ] ) << std::endl;
     sum += std::abs( generated[ i ] );
   }
-  std::cout << "bscale: " << bscale << std::endl;
   std::cout << "total: " <<  sum << std::endl;
 }
 
@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cmath>
+#include <random>
+#include <iostream>
+#include <boost/program_options.hpp>
+#include "ifm/bessel.h"
+#include "ifm/bessel_table.h"
+
+int main( int argc, char* argv[] ) {
+  boost::program_options::options_description options("オプション");
+  options.add_options()
+    ("help,h",    "ヘルプを表示")
+    ("output,o", boost::program_options::value<std::string>()->default_value( "bessel_table.bin" ), "出力ファイル")
+    ("max-x,x", boost::program_options::value<float>()->default_value( 40.f ), "xの最大値")
+    ("step,s", boost::program_options::value<float>()->default_value( 1.f / 64.f ), "xの間隔")
+    ("max,m", boost::program_options::value<unsigned int>()->default_value( 64u ), "最大階数")
+    ("check,c", boost::program_options::value<unsigned int>()->default_value( 100000u ), "誤差を調べる点の数");
+  boost::program_options::variables_map params;
+  boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
+  boost::program_options::notify( params );
+  if( params.count("help") ) {
+    std::cout << options << std::endl;
+    return 0;
+  }
+  const float max_x = params[ "max-x" ].as< float >();
+  const unsigned int order_count = params[ "max" ].as< unsigned int >();
+  unsigned int last_percent = 101u;
+  const auto progress = [&last_percent]( size_t done, size_t total ) {
+    const unsigned int percent = total ? done * 100u / total : 100u;
+    if( percent == last_percent ) return;
+    last_percent = percent;
+    std::cerr << "\r" << percent << "%" << std::flush;
+    if( done == total ) std::cerr << std::endl;
+  };
+  ifm::bessel_table( max_x, params[ "step" ].as< float >(), order_count, progress ).save( params[ "output" ].as< std::string >() );
+  const ifm::bessel_table table( params[ "output" ].as< std::string >() );
+  std::mt19937 rng( 1u );
+  std::uniform_real_distribution< float > x_dist( 0.f, table.get_max_x() );
+  std::uniform_int_distribution< unsigned int > n_dist( 0u, order_count - 1u );
+  double max_error = 0.0;
+  double max_derivative_error = 0.0;
+  float worst_x = 0.f;
+  unsigned int worst_n = 0u;
+  for( unsigned int i = 0u; i != params[ "check" ].as< unsigned int >(); ++i ) {
+    const float x = x_dist( rng );
+    const unsigned int n = n_dist( rng );
+    const auto [y,dy] = table.value_and_derivative( x, n );
+    const double expected = ifm::bessel_kind1_reference( x, n );
+    const double expected_derivative = 0.5 * ( ifm::bessel_kind1_reference( x, int( n ) - 1 ) - ifm::bessel_kind1_reference( x, n + 1 ) );
+    const double error = std::abs( y - expected );
+    if( error > max_error ) {
+      max_error = error;
+      worst_x = x;
+      worst_n = n;
+    }
+    max_derivative_error = std::max( max_derivative_error, std::abs( dy - expected_derivative ) );
+  }
+  std::cout << "points: " << table.get_max_x() / table.get_step() + 1.f << " orders: " << table.get_order_count() << std::endl;
+  std::cout << "max error: " << max_error << " (x=" << worst_x << " n=" << worst_n << ")" << std::endl;
+  std::cout << "max derivative error: " << max_derivative_error << std::endl;
+}
@@ -39,16 +39,17 @@ SOFTWARE.
 #include "ifm/bessel.h"
 #include "ifm/fm.h"
 #include "ifm/adam.h"
+#include "ifm/sideband.h"
 #include "ifm/2op.h"
 #include "ifm/exp_match.h"
 int main( int argc, char *argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
     ("help,h",    "ヘルプを表示")
-    ("bessel,b", boost::program_options::value<std::string>()->default_value( "bessel.mp" ), "ベッセル関数近似係数")
     ("input,i", boost::program_options::value<std::string>(), "入力ファイル")
     ("resolution,r", boost::program_options::value<int>()->default_value(13),  "分解能")
-    ("note,n", boost::program_options::value<int>()->default_value(60), "音階");
+    ("note,n", boost::program_options::value<int>()->default_value(60), "音階")
+    ("harmony-count", boost::program_options::value<unsigned int>()->default_value(ifm::default_harmony_count), "推定に使う倍音の数 (0なら音域全体)");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
@@ -86,22 +87,30 @@ int main( int argc, char *argv[] ) {
     for( unsigned int x = 1; x != harms; ++x )
       harm[ y * harms + ( x - 1 ) ] = image[ y * width + x * 24 ]/ec[ y ];
   }
-  std::vector< std::pair< float, float > > pre;
-  {
-    std::ifstream bessel_file( params["bessel"].as<std::string>(), std::ofstream::binary );
-    nlohmann::json bessel = nlohmann::json::from_msgpack( bessel_file );
-    for( const auto &v: bessel )
-      pre.emplace_back( v.at( 0 ), v.at( 1 ) );
-  }
   std::vector< float > loss( ec.size() );
   std::vector< float > em( ec.size() );
 
-  for( unsigned int freq = 1; freq != 20; ++freq ) {
-    const auto n = ifm::generate_n( freq );
-    for( unsigned int b_ = 0; b_ != 4000; ++b_ ) {
-      float b = b_ * 0.005f;
-      auto [loss,d] = ifm::lossimage( harm.data() + highest * harms, pre, freq, b, n );
-      std::cout << freq << " " << b << " " << loss << " " << d << std::endl;
+  const unsigned int harmony_count = params[ "harmony-count" ].as< unsigned int >() ?
+    std::min( params[ "harmony-count" ].as< unsigned int >(), harms - 1u ) :
+    harms - 1u;
+  constexpr unsigned int b_count = 4000;
+  std::vector< float > bs( b_count );
+  for( unsigned int b_ = 0; b_ != b_count; ++b_ )
+    bs[ b_ ] = b_ * 0.005f;
+  const float *expected = harm.data() + highest * harms;
+  std::vector< ifm::sideband_kernel > kernels;
+  for( unsigned int freq = 1; freq != 20; ++freq )
+    kernels.emplace_back( 1, freq, harmony_count );
+  std::vector< float > losses( kernels.size() * b_count );
+  std::vector< float > gradients( kernels.size() * b_count );
+  ifm::lossimage( expected, kernels, bs.data(), bs.size(), losses.data(), gradients.data() );
+  for( unsigned int k = 0; k != kernels.size(); ++k ) {
+    float unreachable = 0;
+    for( unsigned int h = 0; h != kernels[ k ].get_harmony_count(); ++h )
+      if( !kernels[ k ].is_reachable( h ) ) unreachable += std::abs( expected[ h ] );
+    for( unsigned int b_ = 0; b_ != b_count; ++b_ ) {
+      const float l = losses[ k * b_count + b_ ];
+      std::cout << kernels[ k ].get_modulator() << " " << bs[ b_ ] << " " << l << " " << l - unreachable << " " << gradients[ k * b_count + b_ ] << std::endl;
     }
     std::cout << std::endl;
   }
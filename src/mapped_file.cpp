@@ -0,0 +1,58 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ifm/mapped_file.h"
+
+namespace ifm {
+  mapped_file::mapped_file( const std::string &filename ) : head( nullptr ), length( 0u ) {
+    const int fd = open( filename.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+      std::cerr << "Unable to open " << filename << std::endl;
+      throw unable_to_map_file {};
+    }
+    struct stat status;
+    if( fstat( fd, &status ) < 0 ) {
+      close( fd );
+      std::cerr << "Unable to stat " << filename << std::endl;
+      throw unable_to_map_file {};
+    }
+    length = status.st_size;
+    if( length ) {
+      void *mapped = mmap( nullptr, length, PROT_READ, MAP_SHARED, fd, 0 );
+      if( mapped == MAP_FAILED ) {
+        close( fd );
+        std::cerr << "Unable to map " << filename << std::endl;
+        throw unable_to_map_file {};
+      }
+      head = reinterpret_cast< const uint8_t* >( mapped );
+    }
+    close( fd );
+  }
+  mapped_file::~mapped_file() {
+    if( head ) munmap( const_cast< uint8_t* >( head ), length );
+  }
+}
@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <array>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <boost/program_options.hpp>
+#include "ifm/fm.h"
+#include "ifm/midi_batch.h"
+
+int main( int argc, char* argv[] ) {
+  boost::program_options::options_description options("オプション");
+  options.add_options()
+    ("help,h",    "ヘルプを表示")
+    ("config,c", boost::program_options::value<std::vector<std::string>>()->composing(),  "設定ファイル(複数指定可, 指定順にプリセット番号0,1,...)")
+    ("input,i", boost::program_options::value<std::vector<std::string>>()->composing(),  "入力ファイル")
+    ("list,l", boost::program_options::value<std::string>(),  "入力ファイル 出力ファイル [プリセット番号] を1行ずつ記述したリスト")
+    ("output,o", boost::program_options::value<std::string>()->default_value( "." ),  "出力ディレクトリ")
+    ("preset,p", boost::program_options::value<unsigned int>()->default_value( 0u ),  "--inputで指定したファイルに使うプリセット番号")
+    ("threads,t", boost::program_options::value<unsigned int>()->default_value( 0u ),  "スレッド数(0でCPUの数)")
+    ("max-length,m", boost::program_options::value<double>()->default_value( 3600.0 ),  "1ファイルあたりの最大長(秒)");
+  boost::program_options::positional_options_description positional;
+  positional.add( "input", -1 );
+  boost::program_options::variables_map params;
+  boost::program_options::store( boost::program_options::command_line_parser( argc, argv ).options( options ).positional( positional ).run(), params );
+  boost::program_options::notify( params );
+  if( params.count("help") || !params.count("config") || !( params.count("input") || params.count("list") ) ) {
+    std::cout << options << std::endl;
+    return 0;
+  }
+  std::vector< std::shared_ptr< const ifm::preset_bank_t< float, 4 > > > presets;
+  for( const auto &filename: params[ "config" ].as< std::vector< std::string > >() )
+    presets.emplace_back( ifm::load_preset_bank< float, 4 >( filename ) );
+  std::vector< ifm::midi_batch_job_t > jobs;
+  if( params.count("input") ) {
+    const std::filesystem::path output_dir( params[ "output" ].as< std::string >() );
+    for( const auto &filename: params[ "input" ].as< std::vector< std::string > >() ) {
+      const auto output = output_dir / std::filesystem::path( filename ).filename().replace_extension( ".wav" );
+      jobs.emplace_back(
+        ifm::midi_batch_job_t()
+          .set_input( filename )
+          .set_output( output.string() )
+          .set_preset( params[ "preset" ].as< unsigned int >() )
+      );
+    }
+  }
+  if( params.count("list") ) {
+    std::ifstream list_file( params[ "list" ].as< std::string >() );
+    std::string line;
+    while( std::getline( list_file, line ) ) {
+      std::istringstream fields( line );
+      std::string input;
+      std::string output;
+      unsigned int preset = 0u;
+      if( !( fields >> input >> output ) ) continue;
+      fields >> preset;
+      jobs.emplace_back(
+        ifm::midi_batch_job_t()
+          .set_input( input )
+          .set_output( output )
+          .set_preset( preset )
+      );
+    }
+  }
+  ifm::midi_batch_renderer< 4 > render( presets, params[ "threads" ].as< unsigned int >(), params[ "max-length" ].as< double >() );
+  const auto [results,summary] = render( jobs );
+  for( unsigned int i = 0u; i != jobs.size(); ++i ) {
+    if( results[ i ].succeeded )
+      std::cout << jobs[ i ].input << " -> " << jobs[ i ].output << ": " << results[ i ].audio_length << "s in " << results[ i ].render_time << "s (RTF " << results[ i ].realtime_factor << ", thread " << results[ i ].thread << ")" << std::endl;
+    else
+      std::cerr << jobs[ i ].input << ": failed" << std::endl;
+  }
+  std::cout << "files: " << summary.file_count << " (" << summary.failed_count << " failed)" << std::endl;
+  std::cout << "threads: " << summary.thread_count << std::endl;
+  std::cout << "total: " << summary.audio_length << "s of audio in " << summary.wall_time << "s" << std::endl;
+  std::cout << "throughput: " << summary.throughput << "x realtime, " << ( summary.wall_time > 0 ? summary.file_count / summary.wall_time : 0 ) << " files/s" << std::endl;
+  return summary.failed_count ? 1 : 0;
+}
@@ -0,0 +1,396 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <filesystem>
+#include <boost/program_options.hpp>
+#include "ifm/fm.h"
+#include "ifm/midi_sequencer2.h"
+
+class framing_player_t {
+public:
+  framing_player_t() : expected( 0u ), received( 0u ), messages( 0u ) {}
+  void initialize() {
+    expected = 0u;
+    received = 0u;
+  }
+  bool event( uint8_t v ) {
+    if( v >= 0xF8 ) return false;
+    if( v >= 0x80 ) {
+      const uint8_t event = ( v >> 4 ) & 0x07;
+      expected = ( event == 4u || event == 5u || event == 7u ) ? 1u : 2u;
+      received = 0u;
+      return false;
+    }
+    if( ++received < expected ) return false;
+    received = 0u;
+    ++messages;
+    return true;
+  }
+  template< typename U >
+  void operator()( U* ) {}
+  size_t get_messages() const { return messages; }
+private:
+  uint8_t expected;
+  uint8_t received;
+  size_t messages;
+};
+
+struct out_of_range_access {};
+
+class checked_iterator_t {
+public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = uint8_t;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const uint8_t*;
+  using reference = const uint8_t&;
+  checked_iterator_t() : cur( nullptr ), begin( nullptr ), end( nullptr ) {}
+  checked_iterator_t( const uint8_t *cur_, const uint8_t *begin_, const uint8_t *end_ ) : cur( cur_ ), begin( begin_ ), end( end_ ) {}
+  reference operator*() const {
+    if( cur < begin || cur >= end ) throw out_of_range_access {};
+    return *cur;
+  }
+  reference operator[]( difference_type n ) const { return *( *this + n ); }
+  checked_iterator_t &operator+=( difference_type n ) {
+    if( n > end - cur || n < begin - cur ) throw out_of_range_access {};
+    cur += n;
+    return *this;
+  }
+  checked_iterator_t &operator-=( difference_type n ) { return *this += -n; }
+  checked_iterator_t &operator++() { return *this += 1; }
+  checked_iterator_t &operator--() { return *this -= 1; }
+  checked_iterator_t operator++( int ) {
+    auto temp = *this;
+    ++*this;
+    return temp;
+  }
+  checked_iterator_t operator--( int ) {
+    auto temp = *this;
+    --*this;
+    return temp;
+  }
+  checked_iterator_t operator+( difference_type n ) const {
+    auto temp = *this;
+    return temp += n;
+  }
+  checked_iterator_t operator-( difference_type n ) const {
+    auto temp = *this;
+    return temp -= n;
+  }
+  friend checked_iterator_t operator+( difference_type n, const checked_iterator_t &i ) { return i + n; }
+  difference_type operator-( const checked_iterator_t &r ) const { return cur - r.cur; }
+  bool operator==( const checked_iterator_t &r ) const { return cur == r.cur; }
+  auto operator<=>( const checked_iterator_t &r ) const { return cur <=> r.cur; }
+private:
+  const uint8_t *cur;
+  const uint8_t *begin;
+  const uint8_t *end;
+};
+
+struct midi_file_t {
+  std::vector< uint8_t > data;
+  size_t events;
+};
+
+void put_variable_length( std::vector< uint8_t > &dest, uint32_t v ) {
+  std::array< uint8_t, 5u > temp;
+  unsigned int length = 0u;
+  do {
+    temp[ length++ ] = v & 0x7F;
+    v >>= 7;
+  } while( v );
+  while( length ) {
+    --length;
+    dest.push_back( temp[ length ] | ( length ? 0x80 : 0x00 ) );
+  }
+}
+
+void put_big_endian( std::vector< uint8_t > &dest, uint32_t v, unsigned int bytes ) {
+  for( unsigned int i = bytes; i; --i )
+    dest.push_back( uint8_t( v >> ( ( i - 1u ) * 8u ) ) );
+}
+
+midi_file_t generate_midi( std::mt19937 &rng, unsigned int track_count, unsigned int events_per_track ) {
+  midi_file_t file;
+  file.events = 0u;
+  auto &data = file.data;
+  const std::array< uint8_t, 8u > header_magic{{ 'M', 'T', 'h', 'd', 0, 0, 0, 6 }};
+  data.insert( data.end(), header_magic.begin(), header_magic.end() );
+  put_big_endian( data, 1u, 2u );
+  put_big_endian( data, track_count, 2u );
+  put_big_endian( data, 480u, 2u );
+  std::uniform_int_distribution< unsigned int > kind( 0u, 99u );
+  std::uniform_int_distribution< unsigned int > delta( 0u, 3u );
+  std::uniform_int_distribution< unsigned int > long_delta( 0u, 20000u );
+  std::uniform_int_distribution< unsigned int > data_byte( 0u, 127u );
+  std::uniform_int_distribution< unsigned int > sysex_length( 1u, 64u );
+  for( unsigned int track = 0u; track != track_count; ++track ) {
+    const std::array< uint8_t, 4u > track_magic{{ 'M', 'T', 'r', 'k' }};
+    data.insert( data.end(), track_magic.begin(), track_magic.end() );
+    const size_t length_offset = data.size();
+    put_big_endian( data, 0u, 4u );
+    const size_t track_begin = data.size();
+    const uint8_t channel = track % 16u;
+    uint8_t running_status = 0u;
+    for( unsigned int i = 0u; i != events_per_track; ++i ) {
+      put_variable_length( data, kind( rng ) < 95u ? delta( rng ) : long_delta( rng ) );
+      const auto k = kind( rng );
+      uint8_t status;
+      if( k < 50u ) status = 0x90 | channel;
+      else if( k < 60u ) status = 0x80 | channel;
+      else if( k < 75u ) status = 0xB0 | channel;
+      else if( k < 82u ) status = 0xE0 | channel;
+      else if( k < 85u ) status = 0xC0 | channel;
+      else if( k < 88u ) status = 0xD0 | channel;
+      else if( k < 90u ) status = 0xA0 | channel;
+      else if( k < 94u ) status = 0xF0;
+      else status = 0xFF;
+      if( status == 0xF0 ) {
+        const auto length = sysex_length( rng );
+        data.push_back( 0xF0 );
+        put_variable_length( data, length );
+        for( unsigned int j = 1u; j < length; ++j ) data.push_back( data_byte( rng ) );
+        data.push_back( 0xF7 );
+        running_status = 0u;
+      }
+      else if( status == 0xFF ) {
+        data.push_back( 0xFF );
+        if( k < 97u ) {
+          data.push_back( 0x51 );
+          put_variable_length( data, 3u );
+          put_big_endian( data, 300000u + data_byte( rng ) * 2000u, 3u );
+        }
+        else {
+          data.push_back( 0x01 );
+          const auto length = sysex_length( rng );
+          put_variable_length( data, length );
+          for( unsigned int j = 0u; j != length; ++j ) data.push_back( 'a' + data_byte( rng ) % 26u );
+        }
+        running_status = 0u;
+      }
+      else {
+        if( status != running_status ) data.push_back( status );
+        running_status = status;
+        const uint8_t event = ( status >> 4 ) & 0x07;
+        if( status == ( 0xB0 | channel ) ) {
+          constexpr std::array< uint8_t, 6u > controllers{{ 1, 7, 10, 11, 64, 100 }};
+          data.push_back( controllers[ data_byte( rng ) % controllers.size() ] );
+          data.push_back( data_byte( rng ) );
+        }
+        else {
+          data.push_back( data_byte( rng ) );
+          if( event != 4u && event != 5u ) data.push_back( data_byte( rng ) );
+        }
+        ++file.events;
+      }
+    }
+    put_variable_length( data, 0u );
+    data.push_back( 0xFF );
+    data.push_back( 0x2F );
+    data.push_back( 0x00 );
+    const uint32_t track_length = data.size() - track_begin;
+    for( unsigned int i = 0u; i != 4u; ++i )
+      data[ length_offset + i ] = uint8_t( track_length >> ( ( 3u - i ) * 8u ) );
+  }
+  return file;
+}
+
+std::vector< uint8_t > mutate( std::mt19937 &rng, std::vector< uint8_t > data ) {
+  std::uniform_int_distribution< unsigned int > count( 1u, 8u );
+  std::uniform_int_distribution< unsigned int > kind( 0u, 7u );
+  std::uniform_int_distribution< unsigned int > byte( 0u, 255u );
+  const auto mutation_count = count( rng );
+  for( unsigned int i = 0u; i != mutation_count; ++i ) {
+    if( data.empty() ) break;
+    std::uniform_int_distribution< size_t > position( 0u, data.size() - 1u );
+    const auto pos = position( rng );
+    switch( kind( rng ) ) {
+      case 0:
+        data[ pos ] = byte( rng );
+        break;
+      case 1:
+        {
+          constexpr std::array< uint8_t, 8u > interesting{{ 0x00, 0x7F, 0x80, 0xF0, 0xF7, 0xF8, 0xFF, 0x2F }};
+          data[ pos ] = interesting[ byte( rng ) % interesting.size() ];
+          break;
+        }
+      case 2:
+        data.resize( pos );
+        break;
+      case 3:
+        data.erase( std::next( data.begin(), pos ), std::next( data.begin(), std::min( data.size(), pos + byte( rng ) ) ) );
+        break;
+      case 4:
+        {
+          const std::array< uint8_t, 6u > huge_sysex{{ 0x00, 0xF0, 0xFF, 0xFF, 0xFF, 0x7F }};
+          data.insert( std::next( data.begin(), pos ), huge_sysex.begin(), huge_sysex.end() );
+          break;
+        }
+      case 5:
+        {
+          const std::array< uint8_t, 7u > huge_meta{{ 0x00, 0xFF, 0x51, 0x8F, 0xFF, 0xFF, 0x7F }};
+          data.insert( std::next( data.begin(), pos ), huge_meta.begin(), huge_meta.end() );
+          break;
+        }
+      case 6:
+        for( unsigned int j = 0u; j != 4u && pos + j < data.size(); ++j )
+          data[ pos + j ] = byte( rng ) | ( j == 0u ? 0x80 : 0x00 );
+        break;
+      default:
+        {
+          std::vector< uint8_t > chunk( std::next( data.begin(), pos ), std::next( data.begin(), std::min( data.size(), pos + byte( rng ) ) ) );
+          data.insert( std::next( data.begin(), position( rng ) ), chunk.begin(), chunk.end() );
+        }
+    };
+  }
+  return data;
+}
+
+template< typename Sequencer >
+void parse( Sequencer &sequencer, const std::vector< uint8_t > &data ) {
+  if( sequencer.load( data.data(), std::next( data.data(), data.size() ) ) )
+    sequencer.dispatch_all();
+}
+
+template< typename Sequencer >
+void parse_checked( Sequencer &sequencer, const std::vector< uint8_t > &data ) {
+  const uint8_t *begin = data.data();
+  const uint8_t *end = std::next( begin, data.size() );
+  sequencer.load( checked_iterator_t( begin, begin, end ), checked_iterator_t( end, begin, end ) );
+  sequencer.dispatch_all();
+  sequencer.is_end();
+}
+
+int main( int argc, char* argv[] ) {
+  boost::program_options::options_description options("オプション");
+  options.add_options()
+    ("help,h",    "ヘルプを表示")
+    ("config,c", boost::program_options::value<std::string>(),  "設定ファイル")
+    ("input,i", boost::program_options::value<std::vector<std::string>>()->composing(),  "生成したコーパスの代わりに使う入力ファイル")
+    ("files,f", boost::program_options::value<unsigned int>()->default_value( 16u ),  "生成するファイルの数")
+    ("tracks,t", boost::program_options::value<unsigned int>()->default_value( 16u ),  "1ファイルあたりのトラック数")
+    ("events,e", boost::program_options::value<unsigned int>()->default_value( 20000u ),  "1トラックあたりのイベント数")
+    ("iterations,n", boost::program_options::value<unsigned int>()->default_value( 10u ),  "ベンチマークの繰り返し回数")
+    ("seed,s", boost::program_options::value<unsigned int>()->default_value( 1u ),  "乱数のシード")
+    ("save-corpus", boost::program_options::value<std::string>(),  "生成したコーパスを書き出すディレクトリ")
+    ("fuzz", boost::program_options::value<unsigned int>(),  "ベンチマークの代わりに指定回数のファズテストを行う")
+    ("crash-dir", boost::program_options::value<std::string>()->default_value( "." ),  "範囲外アクセスを起こした入力を書き出すディレクトリ");
+  boost::program_options::variables_map params;
+  boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
+  boost::program_options::notify( params );
+  if( params.count("help") || !params.count("config") ) {
+    std::cout << options << std::endl;
+    return 0;
+  }
+  const auto bank = ifm::load_preset_bank< float, 4 >( params[ "config" ].as< std::string >() );
+  std::mt19937 rng( params[ "seed" ].as< unsigned int >() );
+  std::vector< midi_file_t > corpus;
+  if( params.count("input") ) {
+    for( const auto &filename: params[ "input" ].as< std::vector< std::string > >() ) {
+      std::ifstream stream( filename, std::ios::binary );
+      midi_file_t file;
+      file.data.assign( std::istreambuf_iterator< char >( stream ), std::istreambuf_iterator< char >() );
+      ifm::midi_sequencer< const uint8_t*, 4, framing_player_t > counter;
+      if( !counter.load( file.data.data(), std::next( file.data.data(), file.data.size() ) ) ) {
+        std::cerr << filename << ": 読み込めません" << std::endl;
+        return 1;
+      }
+      counter.dispatch_all();
+      file.events = counter.get_player().get_messages();
+      corpus.emplace_back( std::move( file ) );
+    }
+  }
+  else {
+    const auto tracks = std::min( params[ "tracks" ].as< unsigned int >(), 16u );
+    for( unsigned int i = 0u; i != params[ "files" ].as< unsigned int >(); ++i )
+      corpus.emplace_back( generate_midi( rng, tracks, params[ "events" ].as< unsigned int >() ) );
+  }
+  if( params.count("save-corpus") ) {
+    const std::filesystem::path dir( params[ "save-corpus" ].as< std::string >() );
+    std::filesystem::create_directories( dir );
+    for( size_t i = 0u; i != corpus.size(); ++i ) {
+      std::ofstream stream( dir / ( std::to_string( i ) + ".mid" ), std::ios::binary );
+      stream.write( reinterpret_cast< const char* >( corpus[ i ].data.data() ), corpus[ i ].data.size() );
+    }
+  }
+  if( params.count("fuzz") ) {
+    const std::filesystem::path crash_dir( params[ "crash-dir" ].as< std::string >() );
+    std::uniform_int_distribution< size_t > pick( 0u, corpus.size() - 1u );
+    ifm::midi_sequencer< checked_iterator_t, 4, framing_player_t > framing;
+    ifm::midi_sequencer< checked_iterator_t, 4 > dispatching( bank );
+    unsigned int crashes = 0u;
+    const auto iterations = params[ "fuzz" ].as< unsigned int >();
+    for( unsigned int i = 0u; i != iterations; ++i ) {
+      const auto input = mutate( rng, corpus[ pick( rng ) ].data );
+      try {
+        parse_checked( framing, input );
+        parse_checked( dispatching, input );
+      }
+      catch( const out_of_range_access& ) {
+        const auto filename = crash_dir / ( "crash-" + std::to_string( i ) + ".mid" );
+        std::ofstream stream( filename, std::ios::binary );
+        stream.write( reinterpret_cast< const char* >( input.data() ), input.size() );
+        std::cerr << "範囲外アクセス: " << filename.string() << std::endl;
+        ++crashes;
+      }
+    }
+    std::cout << "fuzz iterations: " << iterations << " out of range: " << crashes << std::endl;
+    return crashes ? 1 : 0;
+  }
+  size_t total_events = 0u;
+  size_t total_bytes = 0u;
+  for( const auto &file: corpus ) {
+    total_events += file.events;
+    total_bytes += file.data.size();
+  }
+  const auto iterations = params[ "iterations" ].as< unsigned int >();
+  const auto measure = [&]( auto &sequencer ) {
+    const auto begin = std::chrono::steady_clock::now();
+    for( unsigned int i = 0u; i != iterations; ++i )
+      for( const auto &file: corpus )
+        parse( sequencer, file.data );
+    return std::chrono::duration< double >( std::chrono::steady_clock::now() - begin ).count();
+  };
+  const auto report = [&]( const char *name, double elapsed ) {
+    std::cout << name << ": "
+      << double( total_events ) * iterations / elapsed << " events/s, "
+      << double( total_bytes ) * iterations / elapsed / 1048576.0 << " MiB/s" << std::endl;
+  };
+  std::cout << "files: " << corpus.size() << " events: " << total_events << " bytes: " << total_bytes << std::endl;
+  {
+    ifm::midi_sequencer< const uint8_t*, 4, framing_player_t > sequencer;
+    report( "parse", measure( sequencer ) );
+  }
+  {
+    ifm::midi_sequencer< const uint8_t*, 4 > sequencer( bank );
+    report( "parse+dispatch", measure( sequencer ) );
+  }
+}
@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <iostream>
+#include <boost/program_options.hpp>
+#include "ifm/midi_stream.h"
+#include "ifm/store_monoral.h"
+
+int open_midi_input( const std::string &filename ) {
+  if( filename == "-" ) return STDIN_FILENO;
+  struct stat buf;
+  if( stat( filename.c_str(), &buf ) < 0 ) return -1;
+  if( S_ISSOCK( buf.st_mode ) ) {
+    const int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 ) return -1;
+    sockaddr_un addr;
+    std::memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    if( filename.size() >= sizeof( addr.sun_path ) ) {
+      close( fd );
+      return -1;
+    }
+    std::copy( filename.begin(), filename.end(), addr.sun_path );
+    if( connect( fd, reinterpret_cast< sockaddr* >( &addr ), sizeof( addr ) ) < 0 ) {
+      close( fd );
+      return -1;
+    }
+    return fd;
+  }
+  return open( filename.c_str(), O_RDONLY );
+}
+
+int main( int argc, char* argv[] ) {
+  boost::program_options::options_description options("オプション");
+  options.add_options()
+    ("help,h",    "ヘルプを表示")
+    ("config,c", boost::program_options::value<std::string>(),  "設定ファイル")
+    ("input,i", boost::program_options::value<std::string>()->default_value( "-" ),  "MIDIバイト列の入力元(パイプ, FIFO, UNIXドメインソケット, -で標準入力)")
+    ("output,o", boost::program_options::value<std::string>(),  "出力ファイル")
+    ("latency,l", boost::program_options::value<float>()->default_value( 5.f ),  "入力から発音までの遅延(ミリ秒)")
+    ("max-length,m", boost::program_options::value<float>()->default_value( 3600.f ),  "最大録音時間(秒)");
+  boost::program_options::variables_map params;
+  boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
+  boost::program_options::notify( params );
+  if( params.count("help") || !params.count("config") || !params.count("output") ) {
+    std::cout << options << std::endl;
+    return 0;
+  }
+  const auto bank = ifm::load_preset_bank< float, 4 >( params[ "config" ].as< std::string >() );
+  const int fd = open_midi_input( params[ "input" ].as< std::string >() );
+  if( fd < 0 ) {
+    std::cerr << "Unable to open MIDI input" << std::endl;
+    return -1;
+  }
+  ifm::midi_stream_player< 4 > player(
+    bank,
+    std::chrono::microseconds( int( params[ "latency" ].as< float >() * 1000.f ) )
+  );
+  const size_t max_samples = params[ "max-length" ].as< float >() * ifm::synth_sample_rate;
+  std::vector< float > audio;
+  const auto block_duration = std::chrono::duration_cast< std::chrono::steady_clock::duration >(
+    std::chrono::duration< double >( double( ifm::synth_block_size ) / double( ifm::synth_sample_rate ) )
+  );
+  player.start( fd );
+  auto next = std::chrono::steady_clock::now();
+  while( !player.is_end() && audio.size() < max_samples ) {
+    std::this_thread::sleep_until( next );
+    next += block_duration;
+    const size_t offset = audio.size();
+    audio.resize( offset + ifm::synth_block_size );
+    player( audio.data() + offset );
+  }
+  player.stop();
+  if( fd != STDIN_FILENO ) close( fd );
+  if( player.get_dropped() )
+    std::cerr << player.get_dropped() << " messages dropped" << std::endl;
+  if( !audio.empty() )
+    ifm::store_monoral( params[ "output" ].as< std::string >(), audio, ifm::synth_sample_rate, false );
+}
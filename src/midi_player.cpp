@@ -77,7 +77,7 @@ int main( int argc, char* argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
     ("help,h",    "ヘルプを表示")
-    ("config,c", boost::program_options::value<std::string>(),  "設定ファイル")
+    ("config,c", boost::program_options::value<std::string>(),  "設定ファイル(プログラム番号をキーにしたJSON, またはプログラム番号で始まる名前のJSONを置いたディレクトリも可)")
     ("input,i", boost::program_options::value<std::string>(),  "入力ファイル")
     ("output,o", boost::program_options::value<std::string>(),  "出力ファイル");
   boost::program_options::variables_map params;
@@ -90,13 +90,8 @@ int main( int argc, char* argv[] ) {
   const std::string input_filename = params["input"].as<std::string>();
   const std::string output_filename = params["output"].as<std::string>();
   wavesink sink( output_filename.c_str() );
-  nlohmann::json config;
-  {
-    std::ifstream config_file( params[ "config" ].as< std::string >() );
-    config_file >> config;
-  }
-  auto fm_params = ifm::load_fm_params< 4 >( config );
-  ifm::midi_sequencer< const uint8_t*, 4 > seq( fm_params );
+  const auto bank = ifm::load_preset_bank< float, 4 >( params[ "config" ].as< std::string >() );
+  ifm::midi_sequencer< const uint8_t*, 4 > seq( bank );
   const int fd = open( input_filename.c_str(), O_RDONLY );
   if( fd < 0 ) {
     return -1;
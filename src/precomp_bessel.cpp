@@ -32,13 +32,15 @@ SOFTWARE.
 #include "ifm/setter.h"
 #include "ifm/store_monoral.h"
 #include "ifm/bessel.h"
+#include "ifm/bessel_precomp.h"
 
 int main( int argc, char *argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
     ("help,h",    "ヘルプを表示")
     ("output,o", boost::program_options::value<std::string>()->default_value( "bessel.mp" ), "出力ファイル")
-    ("max,m", boost::program_options::value<int>()->default_value(60), "最大階数");
+    ("max,m", boost::program_options::value<int>()->default_value(60), "最大階数")
+    ("format,f", boost::program_options::value<std::string>()->default_value( "msgpack" ), "出力形式(msgpack, binary)");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
@@ -46,7 +48,23 @@ int main( int argc, char *argv[] ) {
     std::cout << options << std::endl;
     return 0;
   }
-  const auto pre = ifm::create_bessel_approx_2019_precomp_array( params[ "max" ].as< int >() );
+  unsigned int last_percent = 101u;
+  const auto progress = [&last_percent]( size_t done, size_t total ) {
+    const unsigned int percent = total ? done * 100u / total : 100u;
+    if( percent == last_percent ) return;
+    last_percent = percent;
+    std::cerr << "\r" << percent << "%" << std::flush;
+    if( done == total ) std::cerr << std::endl;
+  };
+  const auto pre = ifm::create_bessel_approx_2019_precomp_array( params[ "max" ].as< int >(), progress );
+  if( params[ "format" ].as< std::string >() == "binary" ) {
+    ifm::save_bessel_precomp( params["output"].as<std::string>(), pre );
+    return 0;
+  }
+  if( params[ "format" ].as< std::string >() != "msgpack" ) {
+    std::cout << options << std::endl;
+    return 1;
+  }
   nlohmann::json out( pre );
   auto mp = nlohmann::json::to_msgpack( out );
   std::ofstream out_file( params["output"].as<std::string>(),std::ofstream::binary );
@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <array>
+#include "ifm/bessel.h"
+#include "ifm/sideband.h"
+
+namespace ifm {
+  sideband_kernel::sideband_kernel( unsigned int carrier_, unsigned int modulator_, unsigned int harmony_count_ ) :
+    carrier( carrier_ ), modulator( modulator_ ), harmony_count( harmony_count_ ), order_count( 0u ), reachable( harmony_count_, 0u ) {
+    if( modulator == 0u ) throw invalid_sideband_ratio {};
+    const int max_order = int( ( harmony_count + carrier ) / modulator );
+    for( int k = -max_order; k <= max_order; ++k ) {
+      const int freq = int( carrier ) + k * int( modulator );
+      const unsigned int harmony = unsigned( std::abs( freq ) );
+      if( harmony == 0u || harmony > harmony_count ) continue;
+      const unsigned int order = unsigned( std::abs( k ) );
+      const float bessel_sign = ( k < 0 && order % 2u ) ? -1.f : 1.f;
+      const float fold_sign = freq < 0 ? -1.f : 1.f;
+      sidebands.push_back( sideband_t{ harmony - 1u, order, bessel_sign * fold_sign } );
+      reachable[ harmony - 1u ] = 1u;
+      order_count = std::max( order_count, order + 1u );
+    }
+    std::sort( sidebands.begin(), sidebands.end(), []( const sideband_t &l, const sideband_t &r ) {
+      return l.harmony < r.harmony || ( l.harmony == r.harmony && l.order < r.order );
+    } );
+  }
+  namespace {
+    template< unsigned int harmony_count, bool with_gradient >
+    void accumulate_fixed( const std::vector< sideband_t > &sidebands, const float *bessel, const float *dbessel, float *magnitude, float *gradient ) {
+      std::array< float, harmony_count > m{};
+      std::array< float, harmony_count > g{};
+      for( const auto &s: sidebands ) {
+        m[ s.harmony ] += s.sign * bessel[ s.order ];
+        if constexpr ( with_gradient ) g[ s.harmony ] += s.sign * dbessel[ s.order ];
+      }
+      float sum = 0.f;
+      float dsum = 0.f;
+      for( unsigned int i = 0u; i != harmony_count; ++i ) {
+        if constexpr ( with_gradient ) {
+          g[ i ] = m[ i ] < 0.f ? -g[ i ] : g[ i ];
+          dsum += g[ i ];
+        }
+        m[ i ] = std::abs( m[ i ] );
+        sum += m[ i ];
+      }
+      const float inv_sum = sum == 0.f ? 1.f : 1.f / sum;
+      const float dscale = sum == 0.f ? 0.f : dsum * inv_sum;
+      for( unsigned int i = 0u; i != harmony_count; ++i ) {
+        if constexpr ( with_gradient ) gradient[ i ] = ( g[ i ] - m[ i ] * dscale ) * inv_sum;
+        magnitude[ i ] = m[ i ] * inv_sum;
+      }
+    }
+    template< unsigned int harmony_count >
+    void accumulate_fixed( const std::vector< sideband_t > &sidebands, const float *bessel, const float *dbessel, float *magnitude, float *gradient ) {
+      if( gradient ) accumulate_fixed< harmony_count, true >( sidebands, bessel, dbessel, magnitude, gradient );
+      else accumulate_fixed< harmony_count, false >( sidebands, bessel, dbessel, magnitude, gradient );
+    }
+  }
+  void sideband_kernel::accumulate( const float *bessel, const float *dbessel, float *magnitude, float *gradient ) const {
+    switch( harmony_count ) {
+      case 16u: return accumulate_fixed< 16u >( sidebands, bessel, dbessel, magnitude, gradient );
+      case 32u: return accumulate_fixed< 32u >( sidebands, bessel, dbessel, magnitude, gradient );
+      case 50u: return accumulate_fixed< 50u >( sidebands, bessel, dbessel, magnitude, gradient );
+      case 64u: return accumulate_fixed< 64u >( sidebands, bessel, dbessel, magnitude, gradient );
+      case 128u: return accumulate_fixed< 128u >( sidebands, bessel, dbessel, magnitude, gradient );
+      default: break;
+    }
+    std::fill( magnitude, std::next( magnitude, harmony_count ), 0.f );
+    if( gradient ) std::fill( gradient, std::next( gradient, harmony_count ), 0.f );
+    for( const auto &s: sidebands ) {
+      magnitude[ s.harmony ] += s.sign * bessel[ s.order ];
+      if( gradient ) gradient[ s.harmony ] += s.sign * dbessel[ s.order ];
+    }
+    float sum = 0.f;
+    float dsum = 0.f;
+    for( unsigned int i = 0u; i != harmony_count; ++i ) {
+      if( gradient ) {
+        if( magnitude[ i ] < 0.f ) gradient[ i ] = -gradient[ i ];
+        dsum += gradient[ i ];
+      }
+      magnitude[ i ] = std::abs( magnitude[ i ] );
+      sum += magnitude[ i ];
+    }
+    if( sum == 0.f ) return;
+    const float inv_sum = 1.f / sum;
+    for( unsigned int i = 0u; i != harmony_count; ++i ) {
+      if( gradient ) gradient[ i ] = ( gradient[ i ] - magnitude[ i ] * dsum * inv_sum ) * inv_sum;
+      magnitude[ i ] *= inv_sum;
+    }
+  }
+  void sideband_kernel::operator()( float b, float *magnitude, float *gradient ) const {
+    thread_local std::vector< float > bessel;
+    thread_local std::vector< float > dbessel;
+    bessel.resize( order_count );
+    dbessel.resize( order_count );
+    bessel_kind1_sequence( b, order_count, bessel.data(), gradient ? dbessel.data() : nullptr );
+    accumulate( bessel.data(), dbessel.data(), magnitude, gradient );
+  }
+  void sideband_kernel::operator()( const float *b, unsigned int b_count, float *magnitude, float *gradient ) const {
+    const unsigned int count = order_count + 1u;
+    thread_local std::vector< float > bessel;
+    thread_local std::vector< float > dbessel;
+    bessel.resize( size_t( b_count ) * count );
+    dbessel.resize( order_count );
+    bessel_kind1_sequence( b, b_count, count, bessel.data() );
+    for( unsigned int r = 0u; r != b_count; ++r ) {
+      const float *j = bessel.data() + size_t( r ) * count;
+      if( gradient && order_count ) {
+        dbessel[ 0 ] = -j[ 1 ];
+        for( unsigned int n = 1u; n != order_count; ++n )
+          dbessel[ n ] = 0.5f * ( j[ n - 1u ] - j[ n + 1u ] );
+      }
+      accumulate(
+        j, dbessel.data(),
+        magnitude + size_t( r ) * harmony_count,
+        gradient ? gradient + size_t( r ) * harmony_count : nullptr
+      );
+    }
+  }
+}
@@ -29,6 +29,9 @@ SOFTWARE.
 
 namespace ifm {
 void store_monoral( const std::string &filename, const std::vector< float > &samples, unsigned int sample_rate ) {
+  store_monoral( filename, samples, sample_rate, true );
+}
+void store_monoral( const std::string &filename, const std::vector< float > &samples, unsigned int sample_rate, bool norm ) {
   SF_INFO info;
   info.frames = 0;
   info.samplerate = sample_rate;
@@ -43,7 +46,7 @@ void store_monoral( const std::string &filename, const std::vector< float > &sam
       ( max_iter != samples.end() ) ? std::abs( *max_iter ) : int16_t( 0 ),
       ( min_iter != samples.end() ) ? std::abs( *min_iter ) : int16_t( 0 )
     );
-  float scale = 0.8f / max;
+  float scale = norm ? 0.8f / max : 1.f;
   auto audio_file = sf_open( filename.c_str(), SFM_WRITE, &info );
   if( !audio_file ) {
     std::cerr << "Unable to open audio file" << std::endl;
@@ -25,11 +25,12 @@ SOFTWARE.
 #include <boost/program_options.hpp>
 #include <nlohmann/json.hpp>
 #include "ifm/bessel.h"
+#include "ifm/bessel_precomp.h"
 int main( int argc, char* argv[] ) {
   boost::program_options::options_description options("ץ");
   options.add_options()
     ("help,h",    "إפɽ")
-    ("bessel,b", boost::program_options::value<std::string>()->default_value( "bessel.mp" ), "٥åؿ")
+    ("bessel,b", boost::program_options::value<std::string>(), "٥åؿ")
     ("abs,a", boost::program_options::value<bool>()->default_value( false ), "")
     ("rank,r", boost::program_options::value<int>()->default_value( 1 ), "n");
   boost::program_options::variables_map params;
@@ -39,13 +40,7 @@ int main( int argc, char* argv[] ) {
     std::cout << options << std::endl;
     return 0;
   }
-  std::vector< std::pair< float, float > > pre;
-  {
-    std::ifstream bessel_file( params["bessel"].as<std::string>(), std::ofstream::binary );
-    nlohmann::json bessel = nlohmann::json::from_msgpack( bessel_file );
-    for( const auto &v: bessel )
-      pre.emplace_back( v.at( 0 ), v.at( 1 ) );
-  }
+  const ifm::bessel_precomp pre = params.count("bessel") ? ifm::bessel_precomp( params["bessel"].as<std::string>() ) : ifm::bessel_precomp();
   for( float b = 0.f; b < 40.f; b += 0.1f ) {
     float l = ifm::bessel_kind1( b, params[ "rank" ].as< int >() );
     float l1 = ifm::bessel_kind1_approx_2019( b, params[ "rank" ].as< int >() - 1, pre );
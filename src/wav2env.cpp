@@ -41,7 +41,8 @@ int main( int argc, char* argv[] ) {
     ("resolution,r", boost::program_options::value<int>()->default_value(13),  "分解能")
     ("damped,d", boost::program_options::value<bool>()->default_value(false),  "減衰振動")
     ("exp,e", boost::program_options::value<bool>()->default_value(false),  "指数関数近似")
-    ("linear,l", boost::program_options::value<bool>()->default_value(false),  "線形近似");
+    ("linear,l", boost::program_options::value<bool>()->default_value(false),  "線形近似")
+    ("solver,s", boost::program_options::value<std::string>()->default_value("adam"), "最適化手法 (adam|lm)");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
   boost::program_options::notify( params );
@@ -83,9 +84,10 @@ int main( int argc, char* argv[] ) {
   bool damped = params[ "damped" ].as< bool >(); 
   bool exp = params[ "exp" ].as< bool >(); 
   bool linear = params[ "linear" ].as< bool >(); 
-  const auto ece = ifm::get_attack_and_decay_exp( envelope.data(), envelope.size(), 0.01f, damped );
+  const ifm::fit_solver_t solver = params[ "solver" ].as< std::string >() == "lm" ? ifm::fit_solver_t::levenberg_marquardt : ifm::fit_solver_t::adam;
+  const auto ece = ifm::get_attack_and_decay_exp( envelope.data(), envelope.size(), 0.01f, damped, solver );
   std::cout << ece.attack_a << " " << ece.attack_b << " " << ece.decay_a << " " << ece.decay_b <<std::endl;
-  const auto ecf = ifm::get_attack_and_decay( envelope.data(), envelope.size(), 0.01f, damped, damped );
+  const auto ecf = ifm::get_attack_and_decay( envelope.data(), envelope.size(), 0.01f, damped, damped, solver );
   for( unsigned int y = 0; y != envelope.size(); ++y ) {
     float t = 0.01f * y;
     if( damped || y > ece.highest ) {
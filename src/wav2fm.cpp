@@ -27,6 +27,7 @@ SOFTWARE.
 #include <fstream>
 #include <algorithm>
 #include <iterator>
+#include <memory>
 #include <charconv>
 #include <random>
 #include <boost/container/flat_map.hpp>
@@ -39,17 +40,31 @@ SOFTWARE.
 #include "ifm/bessel.h"
 #include "ifm/fm.h"
 #include "ifm/adam.h"
+#include "ifm/sideband.h"
 #include "ifm/2op.h"
+#include "ifm/fit_cache.h"
 #include "ifm/exp_match.h"
 int main( int argc, char *argv[] ) {
   boost::program_options::options_description options("オプション");
   options.add_options()
     ("help,h",    "ヘルプを表示")
-    ("bessel,b", boost::program_options::value<std::string>()->default_value( "bessel.mp" ), "ベッセル関数近似係数")
     ("input,i", boost::program_options::value<std::string>(), "入力ファイル")
     ("resolution,r", boost::program_options::value<int>()->default_value(13),  "分解能")
     ("damped,d", boost::program_options::value<bool>()->default_value(false),  "減衰振動")
     ("note,n", boost::program_options::value<int>()->default_value(60), "音階")
+    ("max-iteration", boost::program_options::value<unsigned int>()->default_value(50000), "最大反復回数")
+    ("patience", boost::program_options::value<unsigned int>()->default_value(200), "収束判定までの反復回数")
+    ("loss-tolerance", boost::program_options::value<float>()->default_value(1.0e-6f), "損失の収束閾値")
+    ("gradient-tolerance", boost::program_options::value<float>()->default_value(1.0e-6f), "勾配の収束閾値")
+    ("step-tolerance", boost::program_options::value<float>()->default_value(1.0e-6f), "更新幅の収束閾値")
+    ("search", boost::program_options::value<std::string>()->default_value("grid"), "探索方法 (grid|descent)")
+    ("basin-count", boost::program_options::value<unsigned int>()->default_value(4), "詳細に探索する候補の数")
+    ("chunk-size", boost::program_options::value<unsigned int>()->default_value(32), "並列に推定するフレームの単位")
+    ("solver,s", boost::program_options::value<std::string>()->default_value("adam"), "最適化手法 (adam|lm)")
+    ("harmony-count", boost::program_options::value<unsigned int>()->default_value(0), "推定に使う倍音の数 (0なら音域全体)")
+    ("cache,c", boost::program_options::value<std::string>(), "推定結果のキャッシュファイル")
+    ("cache-resolution", boost::program_options::value<float>()->default_value(1.0e-3f), "キャッシュの量子化幅")
+    ("cache-distance", boost::program_options::value<float>()->default_value(2.0e-2f), "初期値に使う近いキャッシュの距離")
     ("verbose,v", boost::program_options::value<bool>()->default_value(false), "詳細を表示");
   boost::program_options::variables_map params;
   boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
@@ -88,47 +103,70 @@ int main( int argc, char *argv[] ) {
     for( unsigned int x = 1; x != harms; ++x )
       harm[ y * harms + ( x - 1 ) ] = image[ y * width + x * 24 ]/ec[ y ];
   }
-  std::vector< std::pair< float, float > > pre;
-  {
-    std::ifstream bessel_file( params["bessel"].as<std::string>(), std::ofstream::binary );
-    nlohmann::json bessel = nlohmann::json::from_msgpack( bessel_file );
-    for( const auto &v: bessel )
-      pre.emplace_back( v.at( 0 ), v.at( 1 ) );
-  }
   std::vector< float > loss( ec.size() );
   std::vector< float > em( ec.size() );
-  const auto [l,freq,b] = ifm::find_b_2op( harm.data() + highest * harms, pre );
+  const unsigned int harmony_count = params[ "harmony-count" ].as< unsigned int >() ?
+    std::min( params[ "harmony-count" ].as< unsigned int >(), harms - 1u ) :
+    harms - 1u;
+  const auto config = ifm::fit_config_t()
+    .set_max_iteration( params[ "max-iteration" ].as< unsigned int >() )
+    .set_patience( params[ "patience" ].as< unsigned int >() )
+    .set_loss_tolerance( params[ "loss-tolerance" ].as< float >() )
+    .set_gradient_tolerance( params[ "gradient-tolerance" ].as< float >() )
+    .set_step_tolerance( params[ "step-tolerance" ].as< float >() )
+    .set_search( params[ "search" ].as< std::string >() == "descent" ? ifm::fit_search_t::descent : ifm::fit_search_t::grid )
+    .set_basin_count( params[ "basin-count" ].as< unsigned int >() )
+    .set_chunk_size( params[ "chunk-size" ].as< unsigned int >() )
+    .set_solver( params[ "solver" ].as< std::string >() == "lm" ? ifm::fit_solver_t::levenberg_marquardt : ifm::fit_solver_t::adam )
+    .set_harmony_count( harmony_count );
+  std::vector< ifm::fit_stats_t > stats;
+  std::unique_ptr< ifm::fit_cache > cache;
+  if( params.count( "cache" ) ) {
+    cache.reset( new ifm::fit_cache(
+      params[ "cache" ].as< std::string >(),
+      ifm::fit_cache_config_t()
+        .set_resolution( params[ "cache-resolution" ].as< float >() )
+        .set_warm_distance( params[ "cache-distance" ].as< float >() )
+    ) );
+  }
+  const auto [l,freq,b] = ifm::find_b_2op( harm.data() + highest * harms, config, &stats, cache.get() );
   em[ highest ] = b;
   loss[ highest ] = l;
   std::cout << "modulator freq: " << freq << std::endl;
   std::cout << "modulator scale: " << b << std::endl;
   std::cout << "loss: " << l << std::endl;
-  const auto n = ifm::generate_n( freq );
-  float current_b = b;
-  for( unsigned int y = highest + 1; y < em.size(); ++y ) {
-    auto [l,b_] = ifm::find_b_2op( harm.data() + y * harms, pre, freq, current_b, n );
-    em[ y ] = b_;
-    current_b = std::min( b_, current_b );
-    loss[ y ] = l;
-  }
-  current_b = b;
-  for( unsigned int y = highest; y > 0; --y ) {
-    auto [l,b_] = ifm::find_b_2op( harm.data() + ( y - 1 ) * harms, pre, freq, current_b, n );
-    em[ y - 1 ] = b_;
-    current_b = std::min( b_, current_b );
-    loss[ y ] = l;
+  const ifm::sideband_kernel kernel( 1, freq, config.harmony_count );
+  const auto frames = ifm::find_b_2op_frames( harm.data(), harms, em.size(), highest, b, kernel, config, &stats, cache.get() );
+  if( cache ) cache->save( params[ "cache" ].as< std::string >() );
+  for( unsigned int y = 0; y != em.size(); ++y ) {
+    if( y == highest ) continue;
+    loss[ y ] = std::get< 0 >( frames[ y ] );
+    em[ y ] = std::get< 1 >( frames[ y ] );
   }
   if(  params[ "verbose" ].as< bool >() ) {
+    std::array< unsigned int, 5u > reasons{ 0u };
+    unsigned long iteration = 0u;
+    for( const auto &s: stats ) {
+      iteration += s.iteration;
+      ++reasons[ unsigned( s.reason ) ];
+    }
+    std::cout << "runs: " << stats.size() << " iterations: " << iteration << std::endl;
+    for( unsigned int i = 0u; i != reasons.size(); ++i )
+      std::cout << ifm::to_string( ifm::fit_stop_reason_t( i ) ) << ": " << reasons[ i ] << std::endl;
+    if( cache ) {
+      const auto cache_stats = cache->get_stats();
+      std::cout << "cache exact: " << cache_stats.exact << " nearest: " << cache_stats.nearest << " miss: " << cache_stats.miss << " entries: " << cache->size() << std::endl;
+    }
     for( unsigned int y = 0; y != ec.size(); ++y )
       std::cout << y * 0.01f << " " << ec[ y ]/ec[ highest ] << " " << em[ y ] << " " << loss[ y ] << std::endl;
   }
   bool damped = params[ "damped" ].as< bool >(); 
-  const auto ece = ifm::get_attack_and_decay_exp( ec.data(), ec.size(), 0.01f, damped );
-  const auto eme = ifm::get_attack_and_decay_exp( em.data(), ec.size(), 0.01f, damped );
+  const auto ece = ifm::get_attack_and_decay_exp( ec.data(), ec.size(), 0.01f, damped, config.solver );
+  const auto eme = ifm::get_attack_and_decay_exp( em.data(), ec.size(), 0.01f, damped, config.solver );
   std::cout << ece.attack_a << " " << ece.attack_b << " " << ece.decay_a << " " << ece.decay_b <<std::endl;
   std::cout << eme.attack_a << " " << eme.attack_b << " " << eme.decay_a << " " << eme.decay_b <<std::endl;
-  const auto ecf = ifm::get_attack_and_decay( ec.data(), ec.size(), 0.01f, damped, damped );
-  const auto emf = ifm::get_attack_and_decay( em.data(), em.size(), 0.01f, damped, damped );
+  const auto ecf = ifm::get_attack_and_decay( ec.data(), ec.size(), 0.01f, damped, damped, config.solver );
+  const auto emf = ifm::get_attack_and_decay( em.data(), em.size(), 0.01f, damped, damped, config.solver );
   std::cout << ifm::store_envelope_param_keyframe( ecf.first ).dump() << " " << ecf.second << std::endl;
   std::cout << ifm::store_envelope_param_keyframe( emf.first ).dump() << " " << emf.second << std::endl;
 }
@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2020 Naomasa Matsubayashi
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cmath>
+#include <array>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include "ifm/spectrum_image.h"
+#include "ifm/load_monoral.h"
+#include "ifm/fm_spectrum.h"
+int main( int argc, char *argv[] ) {
+  constexpr unsigned int oper_count = 4u;
+  boost::program_options::options_description options("オプション");
+  options.add_options()
+    ("help,h",    "ヘルプを表示")
+    ("input,i", boost::program_options::value<std::string>(), "入力ファイル")
+    ("resolution,r", boost::program_options::value<int>()->default_value(13),  "分解能")
+    ("note,n", boost::program_options::value<int>()->default_value(60), "音階")
+    ("weight,w", boost::program_options::value<std::string>()->default_value("0,0,0,0,1,0,0,0,0,1,0,0,0,0,1,0,1,0,0,0"), "オペレータの接続 (変調 to+from*4, 出力 16+i)")
+    ("max-ratio", boost::program_options::value<unsigned int>()->default_value(8), "周波数比の最大値")
+    ("basin-count", boost::program_options::value<unsigned int>()->default_value(32), "詳細に探索する候補の数")
+    ("threshold", boost::program_options::value<float>()->default_value(1.0e-4f), "無視する側帯波の大きさ")
+    ("harmony-count", boost::program_options::value<unsigned int>()->default_value(0), "推定に使う倍音の数 (0なら音域全体)");
+  boost::program_options::variables_map params;
+  boost::program_options::store( boost::program_options::parse_command_line( argc, argv, options ), params );
+  boost::program_options::notify( params );
+  if( params.count("help") || !params.count("input") ) {
+    std::cout << options << std::endl;
+    return 0;
+  }
+  std::vector< std::string > weight_str;
+  boost::algorithm::split( weight_str, params[ "weight" ].as< std::string >(), boost::is_any_of( "," ) );
+  ifm::fm_topology_t< oper_count > topology{ 0.f };
+  if( weight_str.size() != topology.size() ) {
+    std::cerr << "接続は " << topology.size() << " 個の値で指定してください" << std::endl;
+    return 1;
+  }
+  std::transform( weight_str.begin(), weight_str.end(), topology.begin(), []( const std::string &v ) { return std::stof( v ); } );
+
+  const auto [audio,sample_rate] = ifm::load_monoral( params["input"].as<std::string>(), true );
+  ifm::spectrum_image conv( params["note"].as<int>(), sample_rate, 1 << params["resolution"].as<int>() );
+  auto [image,delay] = conv( audio );
+  unsigned int width = conv.get_width();
+  unsigned int height = image.size() / width;
+  unsigned int harms = width / 24;
+  if( params[ "harmony-count" ].as< unsigned int >() )
+    harms = std::min( harms, params[ "harmony-count" ].as< unsigned int >() + 1u );
+  unsigned int highest = 0;
+  float highest_sum = 0.f;
+  for( unsigned int y = 0; y != height; ++y ) {
+    float sum = 0;
+    for( unsigned int x = 24; x < width; x += 24 )
+      sum += image[ y * width + x ];
+    if( sum > highest_sum ) {
+      highest_sum = sum;
+      highest = y;
+    }
+    if( sum == 0 ) break;
+  }
+  std::vector< float > harm( harms - 1u );
+  for( unsigned int x = 1; x != harms; ++x )
+    harm[ x - 1 ] = image[ highest * width + x * 24 ]/highest_sum;
+  const auto config = ifm::fm_spectrum_fit_config_t()
+    .set_max_ratio( params[ "max-ratio" ].as< unsigned int >() )
+    .set_basin_count( params[ "basin-count" ].as< unsigned int >() )
+    .set_threshold( params[ "threshold" ].as< float >() );
+  try {
+    const auto fit = ifm::fit_fm_spectrum< oper_count >( harm.data(), harm.size(), topology, config );
+    for( unsigned int i = 0u; i != oper_count; ++i )
+      std::cout << "operator " << i << " freq: " << fit.ratio[ i ] << " scale: " << fit.level[ i ] << std::endl;
+    std::cout << "loss: " << fit.loss << std::endl;
+  }
+  catch( const ifm::invalid_topology& ) {
+    std::cerr << "接続に循環があります" << std::endl;
+    return 1;
+  }
+}